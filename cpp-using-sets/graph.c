@@ -3,50 +3,219 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
 #include <string>
+#include <utility>
 
 constexpr int BITS_PER_UNSIGNED_INT (CHAR_BIT * sizeof(unsigned int));
 
-static void fail(std::string msg) {
-    std::cerr << msg << std::endl;
-    exit(1);
+Graph::Graph(unsigned int n) :
+        n(n),
+        adj_start(n + 1, 0),
+        words_per_row((n + 63) / 64),
+        dense_row(n, -1),
+        label(n, 0u)
+{
 }
 
-Graph::Graph(unsigned int n) : n(n), adjsets(n), label(n, 0u)
+VertexSet::VertexSet(int n, bool full) : words((n + 63) / 64, full ? ~uint64_t(0) : 0)
 {
+    if (full && n % 64)
+        words.back() = (uint64_t(1) << (n % 64)) - 1;
+}
+
+bool Graph::adjacent(int v, int w) const {
+    return std::binary_search(adjlist(v).begin(), adjlist(v).end(), w,
+            [&](int a, int b) { return label[a] < label[b] || (label[a] == label[b] && a < b); });
+}
+
+NeighbourMarker::NeighbourMarker(int n) : stamps(n, 0), stamp(0), row(nullptr)
+{
+}
+
+void NeighbourMarker::mark(const Graph & g, int v) {
+    row = g.adjrow(v);
+    if (row)
+        return;
+    if (++stamp == 0) {
+        std::fill(stamps.begin(), stamps.end(), 0);
+        stamp = 1;
+    }
+    for (int u : g.adjlist(v))
+        stamps[u] = stamp;
+}
+
+// Sets g.adj_start and g.adj from a list of arcs, each of which appears in
+// both directions.  The arcs are bucketed by their tail, then by their head,
+// taking tails in order of label, which leaves each list sorted by label and
+// then by vertex number; finally, duplicates are removed.  Apart from
+// ordering the vertices by label, this takes O(n+m) time.
+static void build_adjlists(Graph& g, const std::vector<std::pair<int, int>> & arcs) {
+    std::vector<int> start(g.n + 1, 0);
+    for (auto & arc : arcs)
+        ++start[arc.first + 1];
+    for (int v=0; v<g.n; v++)
+        start[v + 1] += start[v];
+    std::vector<int> by_tail(arcs.size());
+    std::vector<int> pos(start.begin(), start.end() - 1);
+    for (auto & arc : arcs)
+        by_tail[pos[arc.first]++] = arc.second;
+
+    // Since the arcs are symmetric, listing each tail v under each of its
+    // heads, in increasing order of (label, v), gives neighbour lists in
+    // that order
+    std::vector<int> order(g.n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+            [&](int a, int b) { return g.label[a] < g.label[b]; });
+    std::vector<int> sorted(arcs.size());
+    pos.assign(start.begin(), start.end() - 1);
+    for (int v : order)
+        for (int i=start[v]; i<start[v + 1]; i++)
+            sorted[pos[by_tail[i]]++] = v;
+
+    g.adj.clear();
+    g.adj.reserve(arcs.size());
+    for (int v=0; v<g.n; v++) {
+        g.adj_start[v] = g.adj.size();
+        for (int i=start[v]; i<start[v + 1]; i++)
+            if (i == start[v] || sorted[i] != sorted[i - 1])
+                g.adj.push_back(sorted[i]);
+    }
+    g.adj_start[g.n] = g.adj.size();
 }
 
-void add_edge(Graph& g, int v, int w) {
-    if (v != w) {
-        g.adjsets[v].insert(w);
-        g.adjsets[w].insert(v);
-    } else {
-        // To indicate that a vertex has a loop, we set the most
-        // significant bit of its label to 1
-        g.label[v] |= (1u << (BITS_PER_UNSIGNED_INT-1));
+// Gives a bitset row to each vertex whose row would take no more space than
+// its neighbour list
+static void build_dense_rows(Graph& g) {
+    int dense_count = 0;
+    for (int v=0; v<g.n; v++)
+        if (g.adjlist(v).size() * 32 >= g.n && g.adjlist(v).size() > 0)
+            g.dense_row[v] = dense_count++;
+    g.dense_bits.assign((size_t) dense_count * g.words_per_row, 0);
+    for (int v=0; v<g.n; v++) {
+        if (g.dense_row[v] == -1)
+            continue;
+        uint64_t *row = &g.dense_bits[(size_t) g.dense_row[v] * g.words_per_row];
+        for (int u : g.adjlist(v))
+            row[u >> 6] |= uint64_t(1) << (u & 63);
     }
 }
 
-struct Graph readGraph(char* filename) {
+// The bucket-queue algorithm of Batagelj and Zaversnik, which takes O(n+m)
+// time
+static std::vector<int> degeneracy_ordering(const Graph & g) {
+    std::vector<int> degree(g.n);
+    int max_degree = 0;
+    for (int v=0; v<g.n; v++) {
+        degree[v] = g.adjlist(v).size();
+        max_degree = std::max(max_degree, degree[v]);
+    }
+    // vert holds the vertices sorted by remaining degree; bucket_start[d] is
+    // the position of the first vertex of remaining degree d
+    std::vector<int> bucket_start(max_degree + 2, 0);
+    for (int v=0; v<g.n; v++)
+        ++bucket_start[degree[v] + 1];
+    for (int d=0; d<=max_degree; d++)
+        bucket_start[d + 1] += bucket_start[d];
+    std::vector<int> vert(g.n);
+    std::vector<int> pos(g.n);
+    std::vector<int> next(bucket_start.begin(), bucket_start.end() - 1);
+    for (int v=0; v<g.n; v++) {
+        pos[v] = next[degree[v]]++;
+        vert[pos[v]] = v;
+    }
+    for (int i=0; i<g.n; i++) {
+        int v = vert[i];
+        for (int u : g.adjlist(v)) {
+            if (degree[u] > degree[v]) {
+                // Move u to the front of its bucket, and then into the
+                // bucket below
+                int d = degree[u];
+                int w = vert[bucket_start[d]];
+                std::swap(vert[pos[u]], vert[bucket_start[d]]);
+                std::swap(pos[u], pos[w]);
+                ++bucket_start[d];
+                --degree[u];
+            }
+        }
+    }
+    std::reverse(vert.begin(), vert.end());
+    return vert;
+}
+
+std::vector<int> vertex_order(const Graph & g, VertexOrder order) {
+    if (order == degeneracy_order)
+        return degeneracy_ordering(g);
+    std::vector<int> vv(g.n);
+    std::iota(vv.begin(), vv.end(), 0);
+    if (order == degree_order)
+        std::stable_sort(vv.begin(), vv.end(),
+                [&](int a, int b) { return g.adjlist(a).size() > g.adjlist(b).size(); });
+    return vv;
+}
+
+Graph induced_subgraph(const Graph & g, const std::vector<int> & vv) {
+    std::vector<int> new_number(g.n, -1);
+    for (unsigned int i=0; i<vv.size(); i++)
+        new_number[vv[i]] = i;
+
+    Graph subg(vv.size());
+    std::vector<std::pair<int, int>> arcs;
+    for (int i=0; i<subg.n; i++) {
+        for (int u : g.adjlist(vv[i]))
+            if (new_number[u] != -1)
+                arcs.push_back({i, new_number[u]});
+        subg.label[i] = g.label[vv[i]];
+    }
+    build_adjlists(subg, arcs);
+    build_dense_rows(subg);
+    return subg;
+}
+
+struct Graph readGraph(const char* filename) {
     FILE* f;
     
     if ((f=fopen(filename, "r"))==NULL)
-        fail("Cannot open file");
+        throw std::runtime_error(std::string("Cannot open file ") + filename);
+
+    // Closes f and throws unless a read gave what was expected
+    auto check = [&](bool ok) {
+        if (!ok) {
+            fclose(f);
+            throw std::runtime_error(std::string("Invalid graph file ") + filename);
+        }
+    };
 
     int n, m;
-    fscanf(f, "%d%d", &n, &m);
+    check(fscanf(f, "%d%d", &n, &m) == 2 && n >= 0 && m >= 0);
     struct Graph g(n);
     for (int i=0; i<n; i++) {
         int label;
-        fscanf(f, "%d", &label);
+        check(fscanf(f, "%d", &label) == 1);
         g.label[i] |= label;
     }
+    std::vector<std::pair<int, int>> arcs;
+    arcs.reserve(2 * m);
     for (int i=0; i<m; i++) {
         int v, w;
-        fscanf(f, "%d%d", &v, &w);
-        add_edge(g, v, w);
+        check(fscanf(f, "%d%d", &v, &w) == 2 && v >= 0 && v < n && w >= 0 && w < n);
+        if (v != w) {
+            arcs.push_back({v, w});
+            arcs.push_back({w, v});
+        } else {
+            // To indicate that a vertex has a loop, we set the most
+            // significant bit of its label to 1
+            g.label[v] |= (1u << (BITS_PER_UNSIGNED_INT-1));
+        }
     }
 
+    fclose(f);
+
+    build_adjlists(g, arcs);
+    build_dense_rows(g);
+
     return g;
 }
@@ -1,16 +0,0 @@
-#include <limits.h>
-#include <stdbool.h>
-
-#include <unordered_set>
-#include <vector>
-
-struct Graph {
-    int n;
-    std::vector<std::unordered_set<int>> adjsets;
-    std::vector<std::vector<int>> adjlists;
-    std::vector<unsigned int> label;
-    Graph(unsigned int n);
-};
-
-Graph readGraph(char* filename);
-
@@ -1,4 +1,6 @@
 #include "graph.h"
+#include "batch.h"
+#include "solution_writer.h"
 
 #include <algorithm>
 #include <numeric>
@@ -6,13 +8,14 @@
 #include <iostream>
 #include <set>
 #include <string>
-#include <unordered_set>
 #include <utility>
 #include <vector>
 #include <mutex>
 #include <thread>
 #include <condition_variable>
 #include <atomic>
+#include <stdexcept>
+#include <deque>
 
 #include <argp.h>
 #include <limits.h>
@@ -36,27 +39,51 @@ enum Heuristic { min_max, min_product };
 *******************************************************************************/
 
 static char doc[] = "Find maximal common induced subgraphs";
-static char args_doc[] = "FILENAME1 FILENAME2";
+static char args_doc[] = "FILENAME1 FILENAME2\n--batch=MANIFEST";
 static struct argp_option options[] = {
     {"verbose", 'v', 0, 0, "Verbose output"},
     {"quiet", 'q', 0, 0, "Quiet output; this runs faster"},
     {"connected", 'c', 0, 0, "Solve max common CONNECTED subgraph problem"},
+    {"min-size", 'm', "k", 0, "Only find solutions of at least k vertices, and prune the "
+            "search nodes that cannot lead to one"},
+    {"first", 'f', 0, 0, "Stop at the first solution found; with --min-size, this decides "
+            "whether there is a solution of at least that size"},
     {"timeout", 't', "timeout", 0, "Specify a timeout (seconds)"},
+    {"batch", 'b', "manifest", 0, "Solve each pair of graphs listed in a manifest file; "
+            "this implies --quiet, and --timeout applies to each pair"},
+    {"threads", 'T', "threads", 0, "Number of pairs to solve at once in batch mode (default 1)"},
+    {"order", 'r', "order", 0, "Renumber the vertices of each graph before searching: "
+            "none (the default), degree or degeneracy; solutions are still printed "
+            "with the vertex numbers of the input files"},
+    {"output-thread", 'O', 0, 0, "Write solutions to stdout on a separate thread"},
+    {"binary", 'B', 0, 0, "Write solutions as a compact binary stream, which "
+            "utils/decode_solutions turns back into text"},
     { 0 }
 };
 
 static struct {
     bool verbose;
     bool quiet;
+    bool output_thread;
+    bool binary;
     bool connected;
+    int min_size;
+    bool first;
     char *filename1;
     char *filename2;
+    char *batch_filename;
     int timeout;
+    int threads;
+    VertexOrder order;
     int arg_num;
 } arguments;
 
 static std::atomic<bool> abort_due_to_timeout;
 
+// The flag that the search running on this thread checks.  In batch mode,
+// each pair has its own flag.
+thread_local std::atomic<bool> * abort_search = &abort_due_to_timeout;
+
 static error_t parse_opt (int key, char *arg, struct argp_state *state) {
     switch (key) {
         case 'v':
@@ -65,12 +92,45 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
         case 'q':
             arguments.quiet = true;
             break;
+        case 'O':
+            arguments.output_thread = true;
+            break;
+        case 'B':
+            arguments.binary = true;
+            break;
         case 'c':
             arguments.connected = true;
             break;
+        case 'm':
+            arguments.min_size = std::stoi(arg);
+            if (arguments.min_size < 0)
+                fail("The minimum size must not be negative");
+            break;
+        case 'f':
+            arguments.first = true;
+            break;
         case 't':
             arguments.timeout = std::stoi(arg);
             break;
+        case 'b':
+            arguments.batch_filename = arg;
+            arguments.quiet = true;
+            break;
+        case 'T':
+            arguments.threads = std::stoi(arg);
+            if (arguments.threads < 1)
+                fail("The number of threads must be at least 1");
+            break;
+        case 'r':
+            if (0 == strcmp(arg, "none"))
+                arguments.order = identity_order;
+            else if (0 == strcmp(arg, "degree"))
+                arguments.order = degree_order;
+            else if (0 == strcmp(arg, "degeneracy"))
+                arguments.order = degeneracy_order;
+            else
+                fail("The order must be none, degree or degeneracy");
+            break;
         case ARGP_KEY_ARG:
             if (arguments.arg_num == 0) {
                 arguments.filename1 = arg;
@@ -82,7 +142,7 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
             arguments.arg_num++;
             break;
         case ARGP_KEY_END:
-            if (arguments.arg_num == 0)
+            if (arguments.arg_num == 0 && !arguments.batch_filename)
                 argp_usage(state);
             break;
         default: return ARGP_ERR_UNKNOWN;
@@ -96,8 +156,12 @@ static struct argp argp = { options, parse_opt, args_doc, doc };
                                      Stats
 *******************************************************************************/
 
-unsigned long long nodes{ 0 };
-unsigned long long solution_count{ 0 };
+/* Counted per thread, so that pairs can be solved concurrently in batch mode */
+thread_local unsigned long long nodes{ 0 };
+thread_local unsigned long long solution_count{ 0 };
+
+/* With --first, whether this thread's search has found its solution */
+thread_local bool decided{ false };
 
 /*******************************************************************************
                                  MCS functions
@@ -120,36 +184,80 @@ struct Bidomain {
     int X_count;
 };
 
+// The --connected, --verbose and --quiet flags, as constants, so that each
+// combination of them gets its own copy of the search, in which the tests of
+// the flags are resolved at compile time.  mcs() chooses the copy.
+template <bool Connected, bool Verbose, bool Quiet>
+struct SearchFlags {
+    static constexpr bool connected = Connected;
+    static constexpr bool verbose = Verbose;
+    static constexpr bool quiet = Quiet;
+};
+
+// Scratch space for the children of one search node: their domains, and the
+// sorted right set that is being branched on.  A SearchStack keeps one level
+// for each depth of the search, which successive siblings reuse, so that the
+// search stops allocating memory once it has reached its greatest depth.
+struct SearchLevel {
+    vector<Bidomain> domains;
+    vector<int> ws;
+};
+
+struct SearchStack {
+    std::deque<SearchLevel> levels;  // a deque, so that levels never move
+    unsigned int depth = 0;
+    SearchLevel & push() {
+        if (depth == levels.size())
+            levels.emplace_back();
+        return levels[depth++];
+    }
+    void pop() { --depth; }
+};
+
+// g0_original_ids[v] is the number in the input file of vertex v of the
+// renumbered g0, and likewise for g1; each is empty if its graph was not
+// renumbered.  See renumber().
+static vector<int> g0_original_ids;
+static vector<int> g1_original_ids;
+
+static int original(const vector<int> & original_ids, int v) {
+    return original_ids.empty() ? v : original_ids[v];
+}
+
+template <typename Flags>
 void show_current(const vector<VtxPair>& current)
 {
     ++solution_count;
-    if (arguments.quiet) {
+    decided = arguments.first;
+    if (Flags::quiet) {
         return;
     }
-    for (unsigned int i=0; i<current.size(); i++) {
-        cout << "  (" << current[i].v << " " << current[i].w << ")";
-    }
-    cout << std::endl;
+    for (unsigned int i=0; i<current.size(); i++)
+        solution_writer.put_pair(original(g0_original_ids, current[i].v),
+                original(g1_original_ids, current[i].w));
+    solution_writer.end_line();
 }
 
 void show(const vector<VtxPair>& current, const vector<Bidomain> &domains)
 {
+    solution_writer.flush();
     cout << "Nodes: " << nodes << std::endl;
     cout << "Length of current assignment: " << current.size() << std::endl;
     cout << "Current assignment:";
     for (unsigned int i=0; i<current.size(); i++) {
-        cout << "  (" << current[i].v << " -> " << current[i].w << ")";
+        cout << "  (" << original(g0_original_ids, current[i].v) << " -> "
+             << original(g1_original_ids, current[i].w) << ")";
     }
     cout << std::endl;
     for (unsigned int i=0; i<domains.size(); i++) {
         struct Bidomain bd = domains[i];
         cout << "Left  ";
         for (Iter it=bd.l_start; it!=bd.l_end; it++)
-            cout << *it << " ";
+            cout << original(g0_original_ids, *it) << " ";
         cout << std::endl;
         cout << "Right  ";
         for (Iter it=bd.r_start; it!=bd.r_end; it++)
-            cout << *it << " ";
+            cout << original(g1_original_ids, *it) << " ";
         cout << std::endl;
     }
     cout << "\n" << std::endl;
@@ -169,17 +277,17 @@ bool check_sol(const Graph & g0, const Graph & g1 , const vector<VtxPair> & solu
             return false;
         for (unsigned int j=i+1; j<solution.size(); j++) {
             struct VtxPair p1 = solution[j];
-            if (g0.adjsets[p0.v].count(p1.v) != g1.adjsets[p0.w].count(p1.w))
+            if (g0.adjacent(p0.v, p1.v) != g1.adjacent(p0.w, p1.w))
                 return false;
         }
     }
     return true;
 }
 
-int find_and_remove_first_val(Bidomain & bd, vector<bool> & X) {
+int find_and_remove_first_val(Bidomain & bd, VertexSet & X) {
     for (Iter it=bd.l_start; it!=bd.l_end; it++) {
         int v = *it;
-        if (!X[v]) {
+        if (!X.contains(v)) {
             bd.l_end--;
             std::swap(*it, *bd.l_end);
             return v;
@@ -188,87 +296,109 @@ int find_and_remove_first_val(Bidomain & bd, vector<bool> & X) {
     return -1;
 }
 
+template <typename Flags>
 int select_bidomain(const vector<Bidomain>& domains, int current_matching_size)
 {
     for (unsigned int i=0; i<domains.size(); i++) {
         const Bidomain &bd = domains[i];
         if (bd.l_end - bd.l_start == bd.X_count)
             continue;
-        if (arguments.connected && current_matching_size>0 && !bd.is_adjacent)
+        if (Flags::connected && current_matching_size>0 && !bd.is_adjacent)
             continue;
         return i;
     }
     return -1;
 }
 
+// Whether the solutions below a node must have fewer than --min-size pairs.
+// Each bidomain can add at most as many pairs as the smaller of its right set
+// and the part of its left set that is not in X.
+bool below_min_size(const vector<Bidomain> & domains, unsigned int current_size)
+{
+    unsigned int min_size = arguments.min_size;
+    unsigned int bound = current_size;
+    for (const Bidomain & bd : domains) {
+        if (bound >= min_size)
+            return false;
+        bound += std::min(bd.l_end - bd.l_start - bd.X_count, bd.r_end - bd.r_start);
+    }
+    return bound < min_size;
+}
+
+// Returns the number of vertices in [start, end) that are in X
+int count_in_X(Iter start, Iter end, const VertexSet & X)
+{
+    int count = 0;
+    for (Iter it=start; it!=end; it++)
+        count += X.contains(*it);
+    return count;
+}
+
 // Returns iter to one-past-end of left part
-Iter partition(Iter start, Iter end, const std::unordered_set<int> & adjset) {
+Iter partition(Iter start, Iter end, const NeighbourMarker & neighbours) {
+    if (neighbours.row)
+        return std::partition(start, end,
+                [&](const int elem){ return neighbours.in_row(elem); });
     return std::partition(start, end,
-            [&](const int elem){ return adjset.count(elem); });
+            [&](const int elem){ return neighbours.stamped(elem); });
 }
 
-vector<Bidomain> filter_domains(const vector<Bidomain> & d,
+// Sets new_d to the domains of the child that assigns v to w.  marks0 and
+// marks1 are scratch space for adjacency queries on g0 and g1.
+void filter_domains(const vector<Bidomain> & d, vector<Bidomain> & new_d,
         const Graph & g0, const Graph & g1, int v, int w,
-        vector<bool> & X)
+        VertexSet & X, NeighbourMarker & marks0, NeighbourMarker & marks1)
 {
-    vector<Bidomain> new_d;
-    new_d.reserve(d.size());
+    new_d.clear();
+    if (!d.empty()) {
+        marks0.mark(g0, v);
+        marks1.mark(g1, w);
+    }
     for (const Bidomain &old_bd : d) {
 ////        int l = old_bd.l;
 ////        int r = old_bd.r;
-        Iter l_middle = partition(old_bd.l_start, old_bd.l_end, g0.adjsets[v]);
-        Iter r_middle = partition(old_bd.r_start, old_bd.r_end, g1.adjsets[w]);
+        Iter l_middle = partition(old_bd.l_start, old_bd.l_end, marks0);
+        Iter r_middle = partition(old_bd.r_start, old_bd.r_end, marks1);
 //        int left_len_noedge = old_bd.left_len - left_len;
 //        int right_len_noedge = old_bd.right_len - right_len;
+        // old_bd.X_count is split between the two halves, so only the X
+        // vertices in the smaller half of the left set need to be counted
+        int X_count_edge = 0;
+        if (old_bd.X_count) {
+            if (l_middle - old_bd.l_start <= old_bd.l_end - l_middle)
+                X_count_edge = count_in_X(old_bd.l_start, l_middle, X);
+            else
+                X_count_edge = old_bd.X_count - count_in_X(l_middle, old_bd.l_end, X);
+        }
         if (l_middle != old_bd.l_end && r_middle != old_bd.r_end) {
-            int X_count = 0;
-            for (Iter it=l_middle; it!=old_bd.l_end; it++) {
-                X_count += X[*it];
-            }
             new_d.push_back({l_middle, r_middle, old_bd.l_end, old_bd.r_end,
-                    old_bd.is_adjacent, X_count});
+                    old_bd.is_adjacent, old_bd.X_count - X_count_edge});
         }
         if (old_bd.l_start != l_middle && old_bd.r_start != r_middle) {
-            int X_count = 0;
-            for (Iter it=old_bd.l_start; it!=l_middle; it++) {
-                X_count += X[*it];
-            }
-            new_d.push_back({old_bd.l_start, old_bd.r_start, l_middle, r_middle, true, X_count});
-        }
-    }
-    return new_d;
-}
-
-// returns and Iter to the smallest value in arr that is >w.
-// Assumption: such a value exists
-// Assumption: arr contains no duplicates
-// Assumption: arr does not contain INT_MAX
-Iter iter_to_next_smallest(Iter start, Iter end, int w) {
-    Iter retval;
-    int smallest = INT_MAX;
-    for (Iter it=start; it!=end; it++) {
-        if (*it>w && *it<smallest) {
-            smallest = *it;
-            retval=it;
+            new_d.push_back({old_bd.l_start, old_bd.r_start, l_middle, r_middle, true, X_count_edge});
         }
     }
-    return retval;
 }
 
+template <typename Flags>
 void solve(const Graph & g0, const Graph & g1,
         vector<VtxPair> & current, vector<Bidomain> & domains,
-        vector<bool> & X)
+        VertexSet & X,
+        NeighbourMarker & marks0, NeighbourMarker & marks1, SearchStack & stack)
 {
-    if (abort_due_to_timeout)
+    if (*abort_search || decided)
         return;
 
-    if (arguments.verbose) show(current, domains);
+    if (Flags::verbose) show(current, domains);
     nodes++;
 
-    int bd_idx = select_bidomain(domains, current.size());
+    if (arguments.min_size && below_min_size(domains, current.size()))
+        return;
+
+    int bd_idx = select_bidomain<Flags>(domains, current.size());
     if (bd_idx == -1) {
         bool is_maximal = true;
-        if (arguments.connected && !current.empty()) {
+        if (Flags::connected && !current.empty()) {
             for (auto & bd : domains) {
                 if (bd.X_count && bd.is_adjacent) {
                     is_maximal = false;
@@ -278,8 +408,9 @@ void solve(const Graph & g0, const Graph & g1,
         } else if (!domains.empty()) {
             is_maximal = false;
         }
-        if (is_maximal) {
-            show_current(current);
+        // A connected solution can be smaller than its node's bound
+        if (is_maximal && current.size() >= (unsigned int) arguments.min_size) {
+            show_current<Flags>(current);
 //            std::cout << 1 << std::endl;
         }
         return;
@@ -288,29 +419,47 @@ void solve(const Graph & g0, const Graph & g1,
 
     int v = find_and_remove_first_val(bd, X);
 
-    // Try assigning v to each vertex w beginning at bd.r, in turn
-    int w = -1;
-    bd.r_end--;
-    int num_r_vals = bd.r_end - bd.r_start;
-    for (int i=0; i<=num_r_vals; i++) {
-        Iter iter = iter_to_next_smallest(bd.r_start, bd.r_end+1, w);
-        w = *iter;
+    SearchLevel & level = stack.push();
+    vector<Bidomain> & new_domains = level.domains;
 
-        // swap w to the end of its colour class
-        *iter = *bd.r_end;
+    // Try assigning v to each vertex w in bd's right set, in increasing order.
+    // The children permute the set, so before each child it is rewritten from
+    // a sorted copy, with w at the end.
+    vector<int> & ws = level.ws;
+    ws.assign(bd.r_start, bd.r_end);
+    std::sort(ws.begin(), ws.end());
+    bd.r_end--;
+    for (unsigned int i=0; i<ws.size(); i++) {
+        int w = ws[i];
+        std::copy(ws.begin(), ws.begin() + i, bd.r_start);
+        std::copy(ws.begin() + i + 1, ws.end(), bd.r_start + i);
         *bd.r_end = w;
 
-        auto new_domains = filter_domains(domains, g0, g1, v, w, X);
+        filter_domains(domains, new_domains, g0, g1, v, w, X,
+                marks0, marks1);
         current.push_back(VtxPair(v, w));
-        solve(g0, g1, current, new_domains, X);
+        solve<Flags>(g0, g1, current, new_domains, X, marks0, marks1, stack);
         current.pop_back();
     }
+    stack.pop();
     bd.l_end++;
     bd.r_end++;
-    X[v] = true;
+    X.insert(v);
     ++bd.X_count;
-    solve(g0, g1, current, domains, X);
-    X[v] = false;
+    solve<Flags>(g0, g1, current, domains, X, marks0, marks1, stack);
+    X.erase(v);
+}
+
+// Searches from the root, whose domains are given
+template <typename Flags>
+void search(const Graph & g0, const Graph & g1, vector<Bidomain> & domains)
+{
+    vector<VtxPair> current;
+    VertexSet X(g0.n);
+    NeighbourMarker marks0(g0.n);
+    NeighbourMarker marks1(g1.n);
+    SearchStack stack;
+    solve<Flags>(g0, g1, current, domains, X, marks0, marks1, stack);
 }
 
 void mcs(const Graph & g0, const Graph & g1) {
@@ -347,20 +496,68 @@ void mcs(const Graph & g0, const Graph & g1) {
         domains.push_back({start_l, start_r, left.end(), right.end(), false, 0});
     }
 
-    vector<VtxPair> current;
-    vector<bool> X(g0.n);
-    solve(g0, g1, current, domains, X);
+    switch (4 * arguments.connected + 2 * arguments.verbose + arguments.quiet) {
+        case 0: search<SearchFlags<false, false, false>>(g0, g1, domains); break;
+        case 1: search<SearchFlags<false, false, true>>(g0, g1, domains); break;
+        case 2: search<SearchFlags<false, true, false>>(g0, g1, domains); break;
+        case 3: search<SearchFlags<false, true, true>>(g0, g1, domains); break;
+        case 4: search<SearchFlags<true, false, false>>(g0, g1, domains); break;
+        case 5: search<SearchFlags<true, false, true>>(g0, g1, domains); break;
+        case 6: search<SearchFlags<true, true, false>>(g0, g1, domains); break;
+        case 7: search<SearchFlags<true, true, true>>(g0, g1, domains); break;
+    }
+}
+
+// Renumbers the vertices of g in the order given by --order, and returns
+// the old number of each new vertex, or nothing if g is left as it is
+vector<int> renumber(Graph & g) {
+    if (arguments.order == identity_order)
+        return {};
+    vector<int> original_ids = vertex_order(g, arguments.order);
+    g = induced_subgraph(g, original_ids);
+    return original_ids;
 }
 
-int sum(const vector<int> & vec) {
-    return std::accumulate(std::begin(vec), std::end(vec), 0);
+// Reads a graph for a single search, failing if it cannot
+Graph read_graph_or_fail(const char* filename) {
+    try {
+        return readGraph(filename);
+    } catch (const std::exception & e) {
+        fail(e.what());
+        throw;
+    }
+}
+
+PairStats solve_pair(const char* filename1, const char* filename2,
+        std::atomic<bool> & abort)
+{
+    abort_search = &abort;
+    nodes = 0;
+    solution_count = 0;
+    decided = false;
+    struct Graph g0 = readGraph(filename1);
+    struct Graph g1 = readGraph(filename2);
+    // Batch mode prints no solutions, so the old numbers are not needed
+    renumber(g0);
+    renumber(g1);
+    mcs(g0, g1);
+    return {solution_count, nodes};
 }
 
 int main(int argc, char** argv) {
+    arguments.threads = 1;
     argp_parse(&argp, argc, argv, 0, 0, 0);
 
-    struct Graph g0 = readGraph(arguments.filename1);
-    struct Graph g1 = readGraph(arguments.filename2);
+    if (arguments.binary && arguments.verbose)
+        fail("Binary output cannot be used with --verbose");
+
+    if (arguments.batch_filename) {
+        return run_batch(arguments.batch_filename, arguments.threads, arguments.timeout,
+                solve_pair) ? 1 : 0;
+    }
+
+    struct Graph g0 = read_graph_or_fail(arguments.filename1);
+    struct Graph g1 = read_graph_or_fail(arguments.filename2);
 
     std::thread timeout_thread;
     std::mutex timeout_mutex;
@@ -389,7 +586,16 @@ int main(int argc, char** argv) {
 
     auto start = std::chrono::steady_clock::now();
 
+    g0_original_ids = renumber(g0);
+    g1_original_ids = renumber(g1);
+
+    if (arguments.output_thread)
+        solution_writer.start_thread();
+    if (arguments.binary)
+        solution_writer.start_binary();
+
     mcs(g0, g1);
+    solution_writer.finish();
 
     auto stop = std::chrono::steady_clock::now();
     auto time_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
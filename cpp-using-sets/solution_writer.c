@@ -0,0 +1,180 @@
+#include "solution_writer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+SolutionWriter solution_writer;
+
+// A binary stream starts with the four bytes of binary_stream_magic.  Each
+// solution is then written as the number of pairs at the end of the previous
+// solution that it does not share, plus one; the number of pairs that follow
+// the shared ones; and those pairs, as v then w.  A 0 in place of the first
+// number ends the stream.  All numbers are unsigned LEB128 varints: seven
+// bits per byte, least significant first, with the top bit set on every byte
+// but the last.
+//
+// Since solutions are found in depth-first order, most share all but the
+// last few pairs of the previous solution.
+static const char binary_stream_magic[] = "\x89MCS";
+
+// The two-digit decimal representations of 0 to 99
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static void write_to_stdout(const std::string & s)
+{
+    fwrite(s.data(), 1, s.size(), stdout);
+    fflush(stdout);
+}
+
+SolutionWriter::SolutionWriter()
+    : line_buffered(isatty(STDOUT_FILENO)), binary(false), writing(false), stopping(false)
+{
+    buf.reserve(capacity + 4096);
+}
+
+SolutionWriter::~SolutionWriter()
+{
+    flush();
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+}
+
+void SolutionWriter::start_thread()
+{
+    if (!thread.joinable() && !line_buffered) {
+        full_buf.reserve(capacity + 4096);
+        thread = std::thread(&SolutionWriter::run_thread, this);
+    }
+}
+
+void SolutionWriter::start_binary()
+{
+    binary = true;
+    buf.append(binary_stream_magic, 4);
+}
+
+void SolutionWriter::put_varint(unsigned int n)
+{
+    while (n >= 128) {
+        buf += char(n | 128);
+        n >>= 7;
+    }
+    buf += char(n);
+}
+
+void SolutionWriter::encode_solution()
+{
+    unsigned int shared = 0;
+    while (shared < solution.size() && shared < previous_solution.size()
+            && solution[shared] == previous_solution[shared])
+        shared++;
+    put_varint(previous_solution.size() - shared + 1);
+    put_varint(solution.size() - shared);
+    for (unsigned int i=shared; i<solution.size(); i++) {
+        put_varint(solution[i].first);
+        put_varint(solution[i].second);
+    }
+    previous_solution.swap(solution);
+    solution.clear();
+}
+
+size_t SolutionWriter::format_unsigned(unsigned int n, char *digits)
+{
+    // Fill a buffer from the end, two digits at a time
+    char tmp[10];
+    char *p = tmp + 10;
+    while (n >= 100) {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * (n % 100), 2);
+        n /= 100;
+    }
+    if (n >= 10) {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * n, 2);
+    } else {
+        *--p = '0' + n;
+    }
+    size_t len = tmp + 10 - p;
+    memcpy(digits, p, len);
+    return len;
+}
+
+void SolutionWriter::append_pair(std::string & s, unsigned int v, unsigned int w)
+{
+    char text[25] = "  (";
+    size_t len = 3;
+    len += format_unsigned(v, text + len);
+    text[len++] = ' ';
+    len += format_unsigned(w, text + len);
+    text[len++] = ')';
+    s.append(text, len);
+}
+
+void SolutionWriter::write_buffer()
+{
+    if (!thread.joinable()) {
+        write_to_stdout(buf);
+        buf.clear();
+        return;
+    }
+    // Wait for the writer thread to finish the previous buffer, then hand it
+    // this one
+    std::unique_lock<std::mutex> guard(mutex);
+    cv.wait(guard, [&]{ return !writing; });
+    full_buf.swap(buf);
+    buf.clear();
+    writing = true;
+    cv.notify_all();
+}
+
+void SolutionWriter::flush()
+{
+    if (!buf.empty())
+        write_buffer();
+    if (thread.joinable()) {
+        std::unique_lock<std::mutex> guard(mutex);
+        cv.wait(guard, [&]{ return !writing; });
+    }
+}
+
+void SolutionWriter::finish()
+{
+    if (binary) {
+        put_varint(0);
+        binary = false;
+    }
+    flush();
+}
+
+void SolutionWriter::run_thread()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    while (true) {
+        cv.wait(guard, [&]{ return writing || stopping; });
+        if (!writing)
+            break;
+        guard.unlock();
+        write_to_stdout(full_buf);
+        guard.lock();
+        full_buf.clear();
+        writing = false;
+        cv.notify_all();
+    }
+}
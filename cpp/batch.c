@@ -0,0 +1,172 @@
+#include "batch.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+
+using std::vector;
+using std::cout;
+using std::endl;
+
+static void fail(std::string msg) {
+    std::cerr << msg << std::endl;
+    exit(1);
+}
+
+struct BatchPair {
+    std::string filename1;
+    std::string filename2;
+    std::atomic<bool> abort;
+    bool running;
+    bool done;
+    std::chrono::steady_clock::time_point abort_time;
+    PairStats stats;
+    std::string error;  // why the pair could not be solved, if it could not
+    long long time_elapsed;
+};
+
+static void print_result(const BatchPair & pair)
+{
+    if (!pair.error.empty()) {
+        cout << pair.filename1 << " " << pair.filename2 << " ERROR " << pair.error << endl;
+        return;
+    }
+    cout << pair.filename1 << " " << pair.filename2 << " "
+         << pair.stats.solutions << " " << pair.stats.nodes << " "
+         << pair.time_elapsed;
+    if (pair.abort)
+        cout << " TIMEOUT";
+    cout << endl;
+}
+
+int run_batch(const char* manifest_filename, int threads, int timeout,
+        SolvePairFunction solve_pair)
+{
+    vector<std::string> filenames;
+    std::ifstream manifest(manifest_filename);
+    if (!manifest)
+        fail(std::string("Cannot open file ") + manifest_filename);
+    std::string filename;
+    while (manifest >> filename)
+        filenames.push_back(filename);
+    if (filenames.size() % 2)
+        fail("The batch manifest must contain pairs of filenames");
+
+    vector<BatchPair> pairs(filenames.size() / 2);
+    for (unsigned int i=0; i<pairs.size(); i++) {
+        pairs[i].filename1 = filenames[2*i];
+        pairs[i].filename2 = filenames[2*i+1];
+        pairs[i].abort.store(false);
+        pairs[i].running = false;
+        pairs[i].done = false;
+    }
+
+    // Guards the running, done and abort_time fields, and printing
+    std::mutex mutex;
+    std::condition_variable timeout_cv;
+    bool finished = false;
+    unsigned int next_to_print = 0;
+    std::atomic<unsigned int> next_pair{ 0 };
+
+    auto start = std::chrono::steady_clock::now();
+
+    /* Sets the abort flag of each running pair whose time limit has passed */
+    std::thread timeout_thread;
+    if (0 != timeout) {
+        timeout_thread = std::thread([&] {
+                std::unique_lock<std::mutex> guard(mutex);
+                while (!finished) {
+                    auto now = std::chrono::steady_clock::now();
+                    bool any_running = false;
+                    std::chrono::steady_clock::time_point next_abort_time;
+                    for (auto & pair : pairs) {
+                        if (!pair.running || pair.abort)
+                            continue;
+                        if (pair.abort_time <= now) {
+                            pair.abort.store(true);
+                        } else if (!any_running || pair.abort_time < next_abort_time) {
+                            any_running = true;
+                            next_abort_time = pair.abort_time;
+                        }
+                    }
+                    if (any_running)
+                        timeout_cv.wait_until(guard, next_abort_time);
+                    else
+                        timeout_cv.wait(guard);
+                }
+                });
+    }
+
+    unsigned long long total_solutions = 0;
+    unsigned long long total_nodes = 0;
+    int errors = 0;
+
+    vector<std::thread> workers;
+    for (int i=0; i<threads; i++) {
+        workers.emplace_back([&] {
+                unsigned int i;
+                while ((i = next_pair++) < pairs.size()) {
+                    BatchPair & pair = pairs[i];
+                    auto pair_start = std::chrono::steady_clock::now();
+                    {
+                        std::lock_guard<std::mutex> guard(mutex);
+                        pair.running = true;
+                        pair.abort_time = pair_start + std::chrono::seconds(timeout);
+                    }
+                    timeout_cv.notify_all();
+
+                    // An unreadable pair is reported in its line of results,
+                    // and the batch goes on
+                    try {
+                        pair.stats = solve_pair(pair.filename1.c_str(),
+                                pair.filename2.c_str(), pair.abort);
+                    } catch (const std::exception & e) {
+                        pair.stats = {0, 0};
+                        pair.error = e.what();
+                    }
+
+                    auto pair_stop = std::chrono::steady_clock::now();
+                    std::lock_guard<std::mutex> guard(mutex);
+                    pair.time_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            pair_stop - pair_start).count();
+                    pair.running = false;
+                    pair.done = true;
+                    total_solutions += pair.stats.solutions;
+                    total_nodes += pair.stats.nodes;
+                    errors += !pair.error.empty();
+                    while (next_to_print < pairs.size() && pairs[next_to_print].done)
+                        print_result(pairs[next_to_print++]);
+                }
+                });
+    }
+    for (auto & worker : workers)
+        worker.join();
+
+    if (timeout_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            finished = true;
+        }
+        timeout_cv.notify_all();
+        timeout_thread.join();
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    auto time_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
+
+    cout << "Pairs:                      " << pairs.size() << endl;
+    cout << "Solutions:                  " << total_solutions << endl;
+    cout << "Nodes:                      " << total_nodes << endl;
+    cout << "CPU time (ms):              " << time_elapsed << endl;
+    if (errors)
+        cout << "Errors:                     " << errors << endl;
+    return errors;
+}
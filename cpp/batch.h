@@ -0,0 +1,23 @@
+#pragma once
+
+#include <atomic>
+
+// Counts from the search of one pair of graphs
+struct PairStats {
+    unsigned long long solutions;
+    unsigned long long nodes;
+};
+
+// Solves the pair of graphs in filename1 and filename2, returning early if
+// abort becomes true, and throwing a std::exception if it cannot
+typedef PairStats (*SolvePairFunction)(const char* filename1,
+        const char* filename2, std::atomic<bool> & abort);
+
+// Reads pairs of graph filenames, one pair per line, from manifest_filename
+// and solves them on the given number of threads.  Each pair gets its own
+// timeout (in seconds; 0 for none).  A line of results is printed for each
+// pair, in the order of the manifest.  If solve_pair throws, for instance
+// because a graph file cannot be read, the pair's line gives the error, and
+// the other pairs are still solved.  Returns the number of such pairs.
+int run_batch(const char* manifest_filename, int threads, int timeout,
+        SolvePairFunction solve_pair);
@@ -3,42 +3,126 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
 #include <string>
 
 constexpr int BITS_PER_UNSIGNED_INT (CHAR_BIT * sizeof(unsigned int));
 
-static void fail(std::string msg) {
-    std::cerr << msg << std::endl;
-    exit(1);
+// Rows are padded to a whole number of 64-byte cache lines
+static int words_per_row(unsigned int n) {
+    return (n + 511) / 512 * 8;
 }
 
-Graph::Graph(unsigned int n) {
-    this->n = n;
-    label = std::vector<unsigned int>(n, 0u);
-    adjmat = {n, std::vector<unsigned char>(n, 0)};
+Graph::Graph(unsigned int n) :
+        n(n),
+        words_per_row(::words_per_row(n)),
+        adjbits((size_t) n * words_per_row, 0),
+        label(n, 0u)
+{
 }
 
-Graph induced_subgraph(struct Graph& g, std::vector<int> vv) {
-    Graph subg(vv.size());
-    for (int i=0; i<subg.n; i++)
-        for (int j=0; j<subg.n; j++)
-            subg.adjmat[i][j] = g.adjmat[vv[i]][vv[j]];
+VertexSet::VertexSet(int n, bool full) : words((n + 63) / 64, full ? ~uint64_t(0) : 0)
+{
+    if (full && n % 64)
+        words.back() = (uint64_t(1) << (n % 64)) - 1;
+}
+
+static void set_adjacent(Graph& g, int v, int w) {
+    g.adjbits[(size_t) v * g.words_per_row + (w >> 6)] |= uint64_t(1) << (w & 63);
+}
+
+// Calls f(u) for each neighbour u of v, in increasing order
+template <typename F>
+static void for_each_neighbour(const Graph & g, int v, F f) {
+    const uint64_t *row = g.adjrow(v);
+    for (int i=0; i<g.words_per_row; i++)
+        for (uint64_t word=row[i]; word; word &= word - 1)
+            f(i * 64 + __builtin_ctzll(word));
+}
+
+static std::vector<int> degrees(const Graph & g) {
+    std::vector<int> degree(g.n, 0);
+    for (int v=0; v<g.n; v++) {
+        const uint64_t *row = g.adjrow(v);
+        for (int i=0; i<g.words_per_row; i++)
+            degree[v] += __builtin_popcountll(row[i]);
+    }
+    return degree;
+}
+
+// The bucket-queue algorithm of Batagelj and Zaversnik, which takes O(n+m)
+// time once the degrees are known
+static std::vector<int> degeneracy_ordering(const Graph & g) {
+    std::vector<int> degree = degrees(g);
+    int max_degree = g.n ? *std::max_element(degree.begin(), degree.end()) : 0;
+    // vert holds the vertices sorted by remaining degree; bucket_start[d] is
+    // the position of the first vertex of remaining degree d
+    std::vector<int> bucket_start(max_degree + 2, 0);
+    for (int v=0; v<g.n; v++)
+        ++bucket_start[degree[v] + 1];
+    for (int d=0; d<=max_degree; d++)
+        bucket_start[d + 1] += bucket_start[d];
+    std::vector<int> vert(g.n);
+    std::vector<int> pos(g.n);
+    std::vector<int> next(bucket_start.begin(), bucket_start.end() - 1);
+    for (int v=0; v<g.n; v++) {
+        pos[v] = next[degree[v]]++;
+        vert[pos[v]] = v;
+    }
+    for (int i=0; i<g.n; i++) {
+        int v = vert[i];
+        for_each_neighbour(g, v, [&](int u) {
+            if (degree[u] > degree[v]) {
+                // Move u to the front of its bucket, and then into the
+                // bucket below
+                int d = degree[u];
+                int w = vert[bucket_start[d]];
+                std::swap(vert[pos[u]], vert[bucket_start[d]]);
+                std::swap(pos[u], pos[w]);
+                ++bucket_start[d];
+                --degree[u];
+            }
+        });
+    }
+    std::reverse(vert.begin(), vert.end());
+    return vert;
+}
+
+std::vector<int> vertex_order(const Graph & g, VertexOrder order) {
+    if (order == degeneracy_order)
+        return degeneracy_ordering(g);
+    std::vector<int> vv(g.n);
+    std::iota(vv.begin(), vv.end(), 0);
+    if (order == degree_order) {
+        std::vector<int> degree = degrees(g);
+        std::stable_sort(vv.begin(), vv.end(),
+                [&](int a, int b) { return degree[a] > degree[b]; });
+    }
+    return vv;
+}
+
+Graph induced_subgraph(const Graph & g, const std::vector<int> & vv) {
+    std::vector<int> new_number(g.n, -1);
+    for (unsigned int i=0; i<vv.size(); i++)
+        new_number[vv[i]] = i;
 
-    for (int i=0; i<subg.n; i++)
+    Graph subg(vv.size());
+    for (int i=0; i<subg.n; i++) {
+        for_each_neighbour(g, vv[i], [&](int u) {
+            if (new_number[u] != -1)
+                set_adjacent(subg, i, new_number[u]);
+        });
         subg.label[i] = g.label[vv[i]];
+    }
     return subg;
 }
 
-void add_edge(Graph& g, int v, int w, bool directed=false, unsigned int val=1) {
+void add_edge(Graph& g, int v, int w) {
     if (v != w) {
-        if (directed) {
-            g.adjmat[v][w] |= val;
-            g.adjmat[w][v] |= (val<<16);
-        } else {
-            g.adjmat[v][w] = val;
-            g.adjmat[w][v] = val;
-        }
+        set_adjacent(g, v, w);
+        set_adjacent(g, w, v);
     } else {
         // To indicate that a vertex has a loop, we set the most
         // significant bit of its label to 1
@@ -46,25 +130,34 @@ void add_edge(Graph& g, int v, int w, bool directed=false, unsigned int val=1) {
     }
 }
 
-struct Graph readGraph(char* filename) {
+struct Graph readGraph(const char* filename) {
     FILE* f;
     
     if ((f=fopen(filename, "r"))==NULL)
-        fail("Cannot open file");
+        throw std::runtime_error(std::string("Cannot open file ") + filename);
+
+    // Closes f and throws unless a read gave what was expected
+    auto check = [&](bool ok) {
+        if (!ok) {
+            fclose(f);
+            throw std::runtime_error(std::string("Invalid graph file ") + filename);
+        }
+    };
 
     int n, m;
-    fscanf(f, "%d%d", &n, &m);
+    check(fscanf(f, "%d%d", &n, &m) == 2 && n >= 0 && m >= 0);
     struct Graph g(n);
     for (int i=0; i<n; i++) {
         int label;
-        fscanf(f, "%d", &label);
+        check(fscanf(f, "%d", &label) == 1);
         g.label[i] |= label;
     }
     for (int i=0; i<m; i++) {
         int v, w;
-        fscanf(f, "%d%d", &v, &w);
+        check(fscanf(f, "%d%d", &v, &w) == 2 && v >= 0 && v < n && w >= 0 && w < n);
         add_edge(g, v, w);
     }
+    fclose(f);
 
     return g;
 }
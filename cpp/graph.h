@@ -1,16 +1,79 @@
+#pragma once
+
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 
+#include <new>
 #include <vector>
 
+// Allocates storage aligned to a cache line
+template <typename T>
+struct CacheAlignedAllocator {
+    typedef T value_type;
+    CacheAlignedAllocator() {}
+    template <typename U> CacheAlignedAllocator(const CacheAlignedAllocator<U> &) {}
+    T* allocate(size_t count) {
+        void *p;
+        if (posix_memalign(&p, 64, count * sizeof(T)))
+            throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, size_t) { free(p); }
+};
+
+template <typename T, typename U>
+bool operator==(const CacheAlignedAllocator<T> &, const CacheAlignedAllocator<U> &) { return true; }
+template <typename T, typename U>
+bool operator!=(const CacheAlignedAllocator<T> &, const CacheAlignedAllocator<U> &) { return false; }
+
 struct Graph {
     int n;
-    std::vector<std::vector<unsigned char>> adjmat;
+    // The adjacency matrix, one bit per pair of vertices.  Each row occupies
+    // words_per_row words, and starts on a cache line.
+    int words_per_row;
+    std::vector<uint64_t, CacheAlignedAllocator<uint64_t>> adjbits;
     std::vector<unsigned int> label;
     Graph(unsigned int n);
+
+    const uint64_t *adjrow(int v) const {
+        return &adjbits[(size_t) v * words_per_row];
+    }
+
+    bool adjacent(int v, int w) const {
+        return (adjrow(v)[w >> 6] >> (w & 63)) & 1;
+    }
 };
 
-Graph induced_subgraph(struct Graph& g, std::vector<int> vv);
+// A set of vertices of a graph, stored as a bitset
+struct VertexSet {
+    std::vector<uint64_t> words;
+    explicit VertexSet(int n=0, bool full=false);
+    bool contains(int v) const { return (words[v >> 6] >> (v & 63)) & 1; }
+    void insert(int v) { words[v >> 6] |= uint64_t(1) << (v & 63); }
+    void erase(int v) { words[v >> 6] &= ~(uint64_t(1) << (v & 63)); }
+};
+
+// Orders in which the vertices of a graph can be renumbered before searching
+enum VertexOrder { identity_order, degree_order, degeneracy_order };
+
+// Returns the vertices of g in the given order.  degree_order sorts them by
+// decreasing degree, ties going to the lower number; degeneracy_order
+// reverses the order in which repeatedly deleting a vertex of least
+// remaining degree deletes them, so that the vertices of the densest core
+// come first.
+std::vector<int> vertex_order(const Graph & g, VertexOrder order);
+
+// Returns the subgraph induced by vv, in which vertex i is vertex vv[i] of g
+Graph induced_subgraph(const Graph & g, const std::vector<int> & vv);
+
+// Adds the edge between v and w.  An edge from v to itself is recorded by
+// setting the top bit of v's label, so labels must be set before edges are
+// added.
+void add_edge(Graph& g, int v, int w);
 
-Graph readGraph(char* filename);
+// Reads a graph file.  Throws std::runtime_error, naming the file, if it
+// cannot be opened or is not a valid graph.
+Graph readGraph(const char* filename);
 
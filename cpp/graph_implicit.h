@@ -1,15 +1,87 @@
+#pragma once
+
 #include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include <vector>
 
+// A range of vertices in a Graph's neighbour array
+struct NeighbourList {
+    const int *first;
+    const int *last;
+    const int *begin() const { return first; }
+    const int *end() const { return last; }
+    int size() const { return last - first; }
+};
+
 struct Graph {
     int n;
-    std::vector<std::vector<unsigned char>> adjmat;
-    std::vector<std::vector<int>> adjlists;
+    // Neighbour lists, stored contiguously: the neighbours of v are
+    // adj[adj_start[v]] to adj[adj_start[v+1]-1], in increasing order of
+    // label, and then of vertex number
+    std::vector<int> adj_start;
+    std::vector<int> adj;
+    // Vertices of high degree also have a row of the adjacency matrix, as a
+    // bitset of words_per_row words.  dense_row[v] is the index of v's row
+    // in dense_bits, or -1 if v has no row.
+    int words_per_row;
+    std::vector<int> dense_row;
+    std::vector<uint64_t> dense_bits;
     std::vector<unsigned int> label;
     Graph(unsigned int n);
+
+    NeighbourList adjlist(int v) const {
+        return {adj.data() + adj_start[v], adj.data() + adj_start[v+1]};
+    }
+
+    bool adjacent(int v, int w) const;
+
+    // Returns v's bitset row, or null if v has none
+    const uint64_t *adjrow(int v) const {
+        return dense_row[v] == -1 ? nullptr : &dense_bits[(size_t) dense_row[v] * words_per_row];
+    }
 };
 
-Graph readGraph(char* filename);
+// Answers adjacency queries about one vertex at a time: after mark(g, v),
+// marked(u) is true if and only if u is adjacent to v in g.  If v has a
+// bitset row, queries use it; otherwise mark() stamps v's neighbours, which
+// takes time proportional to the degree of v.
+struct NeighbourMarker {
+    std::vector<unsigned int> stamps;
+    unsigned int stamp;
+    const uint64_t *row;
+    NeighbourMarker(int n);
+    void mark(const Graph & g, int v);
+    bool in_row(int u) const { return (row[u >> 6] >> (u & 63)) & 1; }
+    bool stamped(int u) const { return stamps[u] == stamp; }
+    bool marked(int u) const { return row ? in_row(u) : stamped(u); }
+};
+
+// A set of vertices of a graph, stored as a bitset
+struct VertexSet {
+    std::vector<uint64_t> words;
+    explicit VertexSet(int n=0, bool full=false);
+    bool contains(int v) const { return (words[v >> 6] >> (v & 63)) & 1; }
+    void insert(int v) { words[v >> 6] |= uint64_t(1) << (v & 63); }
+    void erase(int v) { words[v >> 6] &= ~(uint64_t(1) << (v & 63)); }
+};
+
+// Orders in which the vertices of a graph can be renumbered before searching
+enum VertexOrder { identity_order, degree_order, degeneracy_order };
+
+// Returns the vertices of g in the given order.  degree_order sorts them by
+// decreasing degree, ties going to the lower number; degeneracy_order
+// reverses the order in which repeatedly deleting a vertex of least
+// remaining degree deletes them, so that the vertices of the densest core
+// come first.
+std::vector<int> vertex_order(const Graph & g, VertexOrder order);
+
+// Returns the subgraph induced by vv, in which vertex i is vertex vv[i] of g
+Graph induced_subgraph(const Graph & g, const std::vector<int> & vv);
+
+// Reads a graph file.  Throws std::runtime_error, naming the file, if it
+// cannot be opened or is not a valid graph.
+Graph readGraph(const char* filename);
 
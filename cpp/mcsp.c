@@ -1,20 +1,21 @@
-#include "graph.h"
+#include "mcsplit.h"
+#include "batch.h"
+#include "solution_writer.h"
 
-#include <algorithm>
-#include <numeric>
 #include <chrono>
 #include <iostream>
-#include <set>
 #include <string>
-#include <utility>
 #include <vector>
 #include <mutex>
 #include <thread>
 #include <condition_variable>
 #include <atomic>
+#include <fstream>
+#include <stdexcept>
 
 #include <argp.h>
 #include <limits.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,12 +36,42 @@ enum Heuristic { min_max, min_product };
 *******************************************************************************/
 
 static char doc[] = "Find maximal common induced subgraphs";
-static char args_doc[] = "FILENAME1 FILENAME2";
+static char args_doc[] = "FILENAME1 FILENAME2\n--batch=MANIFEST";
 static struct argp_option options[] = {
     {"verbose", 'v', 0, 0, "Verbose output"},
     {"quiet", 'q', 0, 0, "Quiet output; this runs faster"},
     {"connected", 'c', 0, 0, "Solve max common CONNECTED subgraph problem"},
+    {"min-size", 'm', "k", 0, "Only find solutions of at least k vertices, and prune the "
+            "search nodes that cannot lead to one"},
+    {"first", 'f', 0, 0, "Stop at the first solution found; with --min-size, this decides "
+            "whether there is a solution of at least that size"},
     {"timeout", 't', "timeout", 0, "Specify a timeout (seconds)"},
+    {"batch", 'b', "manifest", 0, "Solve each pair of graphs listed in a manifest file; "
+            "this implies --quiet, and --timeout applies to each pair"},
+    {"threads", 'T', "threads", 0, "Number of threads searching the pair of graphs, "
+            "or in batch mode the number of pairs to solve at once (default 1)"},
+    {"split-depth", 'd', "depth", 0, "With more than one thread, let idle threads take branches "
+            "of search nodes up to this depth; with --shard, divide the nodes at this depth "
+            "below the subtree between the shards (default 4)"},
+    {"subtree", 'p', "path", 0, "Only explore the subtree at this branch path from the root, "
+            "e.g. 3.x.0 (branch i takes the i-th smallest w; x is the X branch)"},
+    {"ordered", 'o', 0, 0, "With more than one thread, print solutions in the same order "
+            "as a single-threaded run"},
+    {"shard", 's', "i/k", 0, "Only explore shard i of k; the outputs of the k shards can be "
+            "combined by utils/merge_shards"},
+    {"order", 'r', "order", 0, "Renumber the vertices of each graph before searching: "
+            "none (the default), degree or degeneracy; solutions are still printed "
+            "with the vertex numbers of the input files"},
+    {"checkpoint", 'k', "file", 0, "Save the progress of the search to this file if it is "
+            "stopped by --timeout or SIGTERM, and every --checkpoint-interval seconds; "
+            "the file is removed when the search finishes"},
+    {"checkpoint-interval", 'I', "seconds", 0, "How often to save a checkpoint (default: "
+            "only when the search is stopped)"},
+    {"resume", 'R', "file", 0, "Continue the search saved in a checkpoint file, which must "
+            "have been made with the same graphs and options"},
+    {"output-thread", 'O', 0, 0, "Write solutions to stdout on a separate thread"},
+    {"binary", 'B', 0, 0, "Write solutions as a compact binary stream, which "
+            "utils/decode_solutions turns back into text"},
     { 0 }
 };
 
@@ -48,14 +79,67 @@ static struct {
     bool verbose;
     bool quiet;
     bool connected;
+    int min_size;
+    bool first;
+    bool ordered;
+    bool output_thread;
+    bool binary;
     char *filename1;
     char *filename2;
+    char *batch_filename;
     int timeout;
+    int threads;
+    int split_depth;
+    char *subtree;
+    vector<int> subtree_path;  // -1 stands for an X branch
+    int shard_index;
+    int shard_count;
+    VertexOrder order;
+    char *checkpoint_filename;
+    int checkpoint_interval;
+    char *resume_filename;
     int arg_num;
 } arguments;
 
 static std::atomic<bool> abort_due_to_timeout;
 
+// With --checkpoint, SIGTERM stops the search as a timeout does, so that a
+// checkpoint is saved
+static volatile sig_atomic_t terminated;
+
+static void handle_sigterm(int) {
+    terminated = 1;
+    abort_due_to_timeout.store(true);
+}
+
+// Reads a path of branch numbers such as 3.x.0, in which -1 stands for x
+static vector<int> parse_path(const std::string & path) {
+    vector<int> branches;
+    size_t start = 0;
+    while (start < path.size()) {
+        size_t end = path.find('.', start);
+        if (end == std::string::npos)
+            end = path.size();
+        std::string branch = path.substr(start, end - start);
+        if (branch == "x")
+            branches.push_back(-1);
+        else if (!branch.empty() && branch.find_first_not_of("0123456789") == std::string::npos)
+            branches.push_back(std::stoi(branch));
+        else
+            fail("Invalid path " + path);
+        start = end + 1;
+    }
+    return branches;
+}
+
+// Writes a path as parse_path() reads it
+static std::string path_text(const vector<int> & path) {
+    std::string text;
+    for (unsigned int i=0; i<path.size(); i++)
+        text += (i ? "." : "") + (path[i] == -1 ? "x" : std::to_string(path[i]));
+    return text;
+}
+
 static error_t parse_opt (int key, char *arg, struct argp_state *state) {
     switch (key) {
         case 'v':
@@ -67,9 +151,69 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
         case 'c':
             arguments.connected = true;
             break;
+        case 'm':
+            arguments.min_size = std::stoi(arg);
+            if (arguments.min_size < 0)
+                fail("The minimum size must not be negative");
+            break;
+        case 'f':
+            arguments.first = true;
+            break;
+        case 'o':
+            arguments.ordered = true;
+            break;
+        case 'O':
+            arguments.output_thread = true;
+            break;
+        case 'B':
+            arguments.binary = true;
+            break;
         case 't':
             arguments.timeout = std::stoi(arg);
             break;
+        case 'b':
+            arguments.batch_filename = arg;
+            arguments.quiet = true;
+            break;
+        case 'T':
+            arguments.threads = std::stoi(arg);
+            if (arguments.threads < 1)
+                fail("The number of threads must be at least 1");
+            break;
+        case 'd':
+            arguments.split_depth = std::stoi(arg);
+            break;
+        case 'p':
+            arguments.subtree = arg;
+            arguments.subtree_path = parse_path(arg);
+            break;
+        case 's':
+            if (2 != sscanf(arg, "%d/%d", &arguments.shard_index, &arguments.shard_count)
+                    || arguments.shard_index < 0
+                    || arguments.shard_index >= arguments.shard_count)
+                fail("The shard must be given as i/k, where 0 <= i < k");
+            break;
+        case 'r':
+            if (0 == strcmp(arg, "none"))
+                arguments.order = identity_order;
+            else if (0 == strcmp(arg, "degree"))
+                arguments.order = degree_order;
+            else if (0 == strcmp(arg, "degeneracy"))
+                arguments.order = degeneracy_order;
+            else
+                fail("The order must be none, degree or degeneracy");
+            break;
+        case 'k':
+            arguments.checkpoint_filename = arg;
+            break;
+        case 'I':
+            arguments.checkpoint_interval = std::stoi(arg);
+            if (arguments.checkpoint_interval < 1)
+                fail("The checkpoint interval must be at least 1 second");
+            break;
+        case 'R':
+            arguments.resume_filename = arg;
+            break;
         case ARGP_KEY_ARG:
             if (arguments.arg_num == 0) {
                 arguments.filename1 = arg;
@@ -81,7 +225,7 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
             arguments.arg_num++;
             break;
         case ARGP_KEY_END:
-            if (arguments.arg_num == 0)
+            if (arguments.arg_num == 0 && !arguments.batch_filename)
                 argp_usage(state);
             break;
         default: return ARGP_ERR_UNKNOWN;
@@ -92,288 +236,262 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
 static struct argp argp = { options, parse_opt, args_doc, doc };
 
 /*******************************************************************************
-                                     Stats
+                                    Output
 *******************************************************************************/
 
-unsigned long long nodes{ 0 };
-unsigned long long solution_count{ 0 };
+// g0_original_ids[v] is the number in the input file of vertex v of the
+// renumbered g0, and likewise for g1; each is empty if its graph was not
+// renumbered.  See renumber().
+static vector<int> g0_original_ids;
+static vector<int> g1_original_ids;
 
-/*******************************************************************************
-                                 MCS functions
-*******************************************************************************/
+static int original(const vector<int> & original_ids, int v) {
+    return original_ids.empty() ? v : original_ids[v];
+}
 
-struct VtxPair {
-    int v;
-    int w;
-    VtxPair(int v, int w): v(v), w(w) {}
-};
+// Prints what the search finds, and saves its checkpoints
+struct OutputVisitor : McsplitVisitor {
+    void solution(const vector<VtxPair> & current)
+    {
+        for (unsigned int i=0; i<current.size(); i++)
+            solution_writer.put_pair(original(g0_original_ids, current[i].v),
+                    original(g1_original_ids, current[i].w));
+        solution_writer.end_line();
+    }
 
-using Iter = std::vector<int>::iterator;
+    void node(unsigned long long nodes, const vector<VtxPair> & current,
+            const vector<vector<int>> & left_sets, const vector<vector<int>> & right_sets)
+    {
+        solution_writer.flush();
+        cout << "Nodes: " << nodes << std::endl;
+        cout << "Length of current assignment: " << current.size() << std::endl;
+        cout << "Current assignment:";
+        for (unsigned int i=0; i<current.size(); i++) {
+            cout << "  (" << original(g0_original_ids, current[i].v) << " -> "
+                 << original(g1_original_ids, current[i].w) << ")";
+        }
+        cout << std::endl;
+        for (unsigned int i=0; i<left_sets.size(); i++) {
+            cout << "Left  ";
+            for (int v : left_sets[i])
+                cout << original(g0_original_ids, v) << " ";
+            cout << std::endl;
+            cout << "Right  ";
+            for (int w : right_sets[i])
+                cout << original(g1_original_ids, w) << " ";
+            cout << std::endl;
+        }
+        cout << "\n" << std::endl;
+    }
 
-struct Bidomain {
-    Iter l_start;
-    Iter r_start;
-    Iter l_end;
-    Iter r_end;
-    bool is_adjacent;
-    int X_count;
+    void checkpoint(const vector<int> & path, unsigned long long solutions,
+            unsigned long long nodes);
 };
 
-void show_current(const vector<VtxPair>& current)
-{
-    ++solution_count;
-    if (arguments.quiet) {
-        return;
-    }
-    for (unsigned int i=0; i<current.size(); i++) {
-        cout << "  (" << current[i].v << " " << current[i].w << ")";
-    }
-    cout << std::endl;
-}
+/*******************************************************************************
+                                  Checkpoints
+*******************************************************************************/
 
-void show(const vector<VtxPair>& current, const vector<Bidomain> &domains)
-{
-    cout << "Nodes: " << nodes << std::endl;
-    cout << "Length of current assignment: " << current.size() << std::endl;
-    cout << "Current assignment:";
-    for (unsigned int i=0; i<current.size(); i++) {
-        cout << "  (" << current[i].v << " -> " << current[i].w << ")";
-    }
-    cout << std::endl;
-    for (unsigned int i=0; i<domains.size(); i++) {
-        struct Bidomain bd = domains[i];
-        cout << "Left  ";
-        for (Iter it=bd.l_start; it!=bd.l_end; it++)
-            cout << *it << " ";
-        cout << std::endl;
-        cout << "Right  ";
-        for (Iter it=bd.r_start; it!=bd.r_end; it++)
-            cout << *it << " ";
-        cout << std::endl;
-    }
-    cout << "\n" << std::endl;
-}
+// A checkpoint file records the graphs, the options that change which nodes
+// the search visits, the path of the node at which the search would
+// continue, and the numbers of solutions and nodes counted before it; see
+// McsplitVisitor::checkpoint().  With --checkpoint, it is saved when the
+// search is stopped by --timeout or SIGTERM, and every --checkpoint-interval
+// seconds.  Only a single search thread takes checkpoints.
 
-bool check_sol(const Graph & g0, const Graph & g1 , const vector<VtxPair> & solution) {
-    return true;
-    vector<bool> used_left(g0.n, false);
-    vector<bool> used_right(g1.n, false);
-    for (unsigned int i=0; i<solution.size(); i++) {
-        struct VtxPair p0 = solution[i];
-        if (used_left[p0.v] || used_right[p0.w])
-            return false;
-        used_left[p0.v] = true;
-        used_right[p0.w] = true;
-        if (g0.label[p0.v] != g1.label[p0.w])
-            return false;
-        for (unsigned int j=i+1; j<solution.size(); j++) {
-            struct VtxPair p1 = solution[j];
-            if (g0.adjmat[p0.v][p1.v] != g1.adjmat[p0.w][p1.w])
-                return false;
-        }
-    }
-    return true;
-}
+static const char *order_names[] = { "none", "degree", "degeneracy" };
 
-int find_and_remove_first_val(Bidomain & bd, vector<bool> & X) {
-    for (Iter it=bd.l_start; it!=bd.l_end; it++) {
-        int v = *it;
-        if (!X[v]) {
-            bd.l_end--;
-            std::swap(*it, *bd.l_end);
-            return v;
-        }
-    }
-    return -1;
+// The options that a checkpoint must have been made with, as the keys and
+// values of its lines
+static vector<std::pair<std::string, std::string>> checkpoint_options()
+{
+    std::string shard = arguments.shard_count == 0 ? "none" :
+            std::to_string(arguments.shard_index) + "/" + std::to_string(arguments.shard_count);
+    return {
+        {"Connected", arguments.connected ? "yes" : "no"},
+        {"Min size", std::to_string(arguments.min_size)},
+        {"First", arguments.first ? "yes" : "no"},
+        {"Order", order_names[arguments.order]},
+        {"Subtree", arguments.subtree ? path_text(arguments.subtree_path) : "none"},
+        {"Shard", shard},
+        {"Split depth", std::to_string(arguments.split_depth)},
+    };
 }
 
-int select_bidomain(const vector<Bidomain>& domains, int current_matching_size)
+// Writes a line of a checkpoint file, with its value in the same column as
+// those of the output
+static void write_checkpoint_line(std::ostream & out, const std::string & key,
+        const std::string & value)
 {
-    for (unsigned int i=0; i<domains.size(); i++) {
-        const Bidomain &bd = domains[i];
-        if (bd.l_end - bd.l_start == bd.X_count)
-            continue;
-        if (arguments.connected && current_matching_size>0 && !bd.is_adjacent)
-            continue;
-        return i;
-    }
-    return -1;
+    out << key << ":" << std::string(27 - key.size(), ' ') << value << "\n";
 }
 
-// Returns iter to one-past-end of left part
-Iter partition(Iter start, Iter end, const vector<unsigned char> & adjrow) {
-    return std::partition(start, end,
-            [&](const int elem){ return 0 != adjrow[elem]; });
+void OutputVisitor::checkpoint(const vector<int> & path, unsigned long long solutions,
+        unsigned long long nodes)
+{
+    if (!arguments.checkpoint_filename)
+        return;
+
+    // The solutions found so far must reach the output before the checkpoint
+    // claims them
+    solution_writer.flush();
+    std::string temp_filename = std::string(arguments.checkpoint_filename) + ".tmp";
+    std::ofstream out(temp_filename);
+    write_checkpoint_line(out, "Graphs",
+            std::string(arguments.filename1) + " " + arguments.filename2);
+    for (const auto & option : checkpoint_options())
+        write_checkpoint_line(out, option.first, option.second);
+    write_checkpoint_line(out, "Path", path_text(path));
+    write_checkpoint_line(out, "Solutions", std::to_string(solutions));
+    write_checkpoint_line(out, "Nodes", std::to_string(nodes));
+    out.close();
+    if (!out || rename(temp_filename.c_str(), arguments.checkpoint_filename))
+        fail("Cannot write checkpoint file");
 }
 
-vector<Bidomain> filter_domains(const vector<Bidomain> & d,
-        const Graph & g0, const Graph & g1, int v, int w,
-        vector<bool> & X)
+// Sets up options to continue from the checkpoint in filename
+void load_checkpoint(const char *filename, McsplitOptions & options)
 {
-    vector<Bidomain> new_d;
-    new_d.reserve(d.size());
-    for (const Bidomain &old_bd : d) {
-////        int l = old_bd.l;
-////        int r = old_bd.r;
-        Iter l_middle = partition(old_bd.l_start, old_bd.l_end, g0.adjmat[v]);
-        Iter r_middle = partition(old_bd.r_start, old_bd.r_end, g1.adjmat[w]);
-//        int left_len_noedge = old_bd.left_len - left_len;
-//        int right_len_noedge = old_bd.right_len - right_len;
-        if (l_middle != old_bd.l_end && r_middle != old_bd.r_end) {
-            int X_count = 0;
-            for (Iter it=l_middle; it!=old_bd.l_end; it++) {
-                X_count += X[*it];
-            }
-            new_d.push_back({l_middle, r_middle, old_bd.l_end, old_bd.r_end,
-                    old_bd.is_adjacent, X_count});
+    std::ifstream in(filename);
+    if (!in)
+        fail("Cannot open checkpoint file");
+    std::string line;
+    std::string graphs = std::string(arguments.filename1) + " " + arguments.filename2;
+    auto expected_options = checkpoint_options();
+    unsigned int matching_options = 0;
+    bool has_path = false;
+    while (std::getline(in, line)) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+        std::string key = line.substr(0, colon);
+        size_t start = line.find_first_not_of(' ', colon + 1);
+        std::string value = start == std::string::npos ? "" : line.substr(start);
+        if (key == "Graphs" && value != graphs)
+            fail("The checkpoint is for the graphs " + value);
+        for (const auto & option : expected_options) {
+            if (key != option.first)
+                continue;
+            if (value != option.second)
+                fail("The checkpoint was made with different options");
+            ++matching_options;
         }
-        if (old_bd.l_start != l_middle && old_bd.r_start != r_middle) {
-            int X_count = 0;
-            for (Iter it=old_bd.l_start; it!=l_middle; it++) {
-                X_count += X[*it];
-            }
-            new_d.push_back({old_bd.l_start, old_bd.r_start, l_middle, r_middle, true, X_count});
+        if (key == "Path") {
+            options.resume_path = parse_path(value);
+            has_path = true;
         }
+        if (key == "Solutions")
+            options.resume_solutions = std::stoull(value);
+        if (key == "Nodes")
+            options.resume_nodes = std::stoull(value);
     }
-    return new_d;
+    if (!has_path)
+        fail("Invalid checkpoint file");
+    if (matching_options != expected_options.size())
+        fail("The checkpoint was made with different options");
 }
 
-// returns and Iter to the smallest value in arr that is >w.
-// Assumption: such a value exists
-// Assumption: arr contains no duplicates
-// Assumption: arr does not contain INT_MAX
-Iter iter_to_next_smallest(Iter start, Iter end, int w) {
-    Iter retval;
-    int smallest = INT_MAX;
-    for (Iter it=start; it!=end; it++) {
-        if (*it>w && *it<smallest) {
-            smallest = *it;
-            retval=it;
-        }
-    }
-    return retval;
-}
+/*******************************************************************************
+                                  Running
+*******************************************************************************/
 
-void solve(const Graph & g0, const Graph & g1,
-        vector<VtxPair> & current, vector<Bidomain> & domains,
-        vector<bool> & X)
+// The options of the search given by the command line
+McsplitOptions search_options()
 {
-    if (abort_due_to_timeout)
-        return;
-
-    if (arguments.verbose) show(current, domains);
-    nodes++;
-
-    int bd_idx = select_bidomain(domains, current.size());
-    if (bd_idx == -1) {
-        bool is_maximal = true;
-        if (arguments.connected && !current.empty()) {
-            for (auto & bd : domains) {
-                if (bd.X_count && bd.is_adjacent) {
-                    is_maximal = false;
-                    break;
-                }
-            }
-        } else if (!domains.empty()) {
-            is_maximal = false;
-        }
-        if (is_maximal) {
-            show_current(current);
-//            std::cout << 1 << std::endl;
-        }
-        return;
-    }
-    Bidomain &bd = domains[bd_idx];
-
-    int v = find_and_remove_first_val(bd, X);
-
-    // Try assigning v to each vertex w beginning at bd.r, in turn
-    int w = -1;
-    bd.r_end--;
-    int num_r_vals = bd.r_end - bd.r_start;
-    for (int i=0; i<=num_r_vals; i++) {
-        Iter iter = iter_to_next_smallest(bd.r_start, bd.r_end+1, w);
-        w = *iter;
-
-        // swap w to the end of its colour class
-        *iter = *bd.r_end;
-        *bd.r_end = w;
-
-        auto new_domains = filter_domains(domains, g0, g1, v, w, X);
-        current.push_back(VtxPair(v, w));
-        solve(g0, g1, current, new_domains, X);
-        current.pop_back();
-    }
-    bd.l_end++;
-    bd.r_end++;
-    X[v] = true;
-    ++bd.X_count;
-    solve(g0, g1, current, domains, X);
-    X[v] = false;
+    McsplitOptions options;
+    options.connected = arguments.connected;
+    options.verbose = arguments.verbose;
+    options.quiet = arguments.quiet;
+    options.min_size = arguments.min_size;
+    options.stop_at_first = arguments.first;
+    options.threads = arguments.threads;
+    options.split_depth = arguments.split_depth;
+    options.ordered = arguments.ordered;
+    options.subtree_path = arguments.subtree_path;
+    options.shard_index = arguments.shard_index;
+    options.shard_count = arguments.shard_count;
+    options.abort = &abort_due_to_timeout;
+    return options;
 }
 
-void mcs(const Graph & g0, const Graph & g1) {
-    vector<int> left;  // the buffer of vertex indices for the left partitions
-    vector<int> right;  // the buffer of vertex indices for the right partitions
-    left.reserve(g0.n);
-    right.reserve(g1.n);
-
-    auto domains = vector<Bidomain> {};
-
-    std::set<unsigned int> left_labels;
-    std::set<unsigned int> right_labels;
-    for (unsigned int label : g0.label) left_labels.insert(label);
-    for (unsigned int label : g1.label) right_labels.insert(label);
-    std::set<unsigned int> labels;  // labels that appear in both graphs
-    std::set_intersection(std::begin(left_labels),
-                          std::end(left_labels),
-                          std::begin(right_labels),
-                          std::end(right_labels),
-                          std::inserter(labels, std::begin(labels)));
-
-    // Create a bidomain for each label that appears in both graphs
-    for (unsigned int label : labels) {
-        Iter start_l = left.end();
-        Iter start_r = right.end();
-
-        for (int i=0; i<g0.n; i++)
-            if (g0.label[i]==label)
-                left.push_back(i);
-        for (int i=0; i<g1.n; i++)
-            if (g1.label[i]==label)
-                right.push_back(i);
-
-        domains.push_back({start_l, start_r, left.end(), right.end(), false, 0});
+// Runs the search, turning its errors into failures
+McsplitResult run_search(const Graph & g0, const Graph & g1, const McsplitOptions & options,
+        McsplitVisitor & visitor)
+{
+    try {
+        return mcsplit(g0, g1, options, visitor);
+    } catch (const std::exception & e) {
+        fail(e.what());
+        throw;
     }
+}
 
-    vector<VtxPair> current;
-    vector<bool> X(g0.n);
-    solve(g0, g1, current, domains, X);
+// Renumbers the vertices of g in the order given by --order, and returns
+// the old number of each new vertex, or nothing if g is left as it is
+vector<int> renumber(Graph & g) {
+    if (arguments.order == identity_order)
+        return {};
+    vector<int> original_ids = vertex_order(g, arguments.order);
+    g = induced_subgraph(g, original_ids);
+    return original_ids;
 }
 
-vector<int> calculate_degrees(const Graph & g) {
-    vector<int> degree(g.n, 0);
-    for (int v=0; v<g.n; v++) {
-        for (int w=0; w<g.n; w++) {
-            unsigned int mask = 0xFFFFu;
-            if (g.adjmat[v][w] & mask) degree[v]++;
-            if (g.adjmat[v][w] & ~mask) degree[v]++;  // inward edge, in directed case
-        }
+// Reads a graph for a single search, failing if it cannot
+Graph read_graph_or_fail(const char* filename) {
+    try {
+        return readGraph(filename);
+    } catch (const std::exception & e) {
+        fail(e.what());
+        throw;
     }
-    return degree;
 }
 
-int sum(const vector<int> & vec) {
-    return std::accumulate(std::begin(vec), std::end(vec), 0);
+PairStats solve_pair(const char* filename1, const char* filename2,
+        std::atomic<bool> & abort)
+{
+    struct Graph g0 = readGraph(filename1);
+    struct Graph g1 = readGraph(filename2);
+    // Batch mode prints no solutions, so the old numbers are not needed
+    renumber(g0);
+    renumber(g1);
+    McsplitOptions options = search_options();
+    options.threads = 1;
+    options.abort = &abort;
+    OutputVisitor visitor;
+    // Errors are reported by run_batch()
+    McsplitResult result = mcsplit(g0, g1, options, visitor);
+    return {result.solutions, result.nodes};
 }
 
 int main(int argc, char** argv) {
+    arguments.threads = 1;
+    arguments.split_depth = 4;
     argp_parse(&argp, argc, argv, 0, 0, 0);
 
-    struct Graph g0 = readGraph(arguments.filename1);
-    struct Graph g1 = readGraph(arguments.filename2);
+    if ((arguments.checkpoint_filename || arguments.resume_filename) &&
+            (arguments.batch_filename || arguments.threads > 1))
+        fail("Checkpoints need a single search thread, and cannot be used in batch mode");
+
+    if (arguments.binary && (arguments.verbose || arguments.ordered))
+        fail("Binary output cannot be used with --verbose or --ordered");
+
+    if (arguments.batch_filename) {
+        return run_batch(arguments.batch_filename, arguments.threads, arguments.timeout,
+                solve_pair) ? 1 : 0;
+    }
+
+    struct Graph g0 = read_graph_or_fail(arguments.filename1);
+    struct Graph g1 = read_graph_or_fail(arguments.filename2);
+
+    McsplitOptions options = search_options();
+    if (arguments.resume_filename)
+        load_checkpoint(arguments.resume_filename, options);
+    if (arguments.checkpoint_filename)
+        signal(SIGTERM, handle_sigterm);
 
     std::thread timeout_thread;
+    std::thread checkpoint_thread;
+    std::atomic<bool> checkpoint_due{ false };
     std::mutex timeout_mutex;
     std::condition_variable timeout_cv;
     abort_due_to_timeout.store(false);
@@ -398,41 +516,50 @@ int main(int argc, char** argv) {
                 });
     }
 
+    // The search only tracks where it is, for the checkpoint taken when it
+    // stops, if checkpoint_due is given
+    if (arguments.checkpoint_filename)
+        options.checkpoint_due = &checkpoint_due;
+    if (arguments.checkpoint_filename && arguments.checkpoint_interval) {
+        checkpoint_thread = std::thread([&] {
+                std::unique_lock<std::mutex> guard(timeout_mutex);
+                while (!timeout_cv.wait_for(guard, std::chrono::seconds(arguments.checkpoint_interval),
+                            [] { return abort_due_to_timeout.load(); }))
+                    checkpoint_due = true;
+                });
+    }
+
     auto start = std::chrono::steady_clock::now();
 
-//    vector<int> g0_deg = calculate_degrees(g0);
-//    vector<int> g1_deg = calculate_degrees(g1);
-//
-//    vector<int> vv0(g0.n);
-//    std::iota(std::begin(vv0), std::end(vv0), 0);
-//    bool g1_dense = sum(g1_deg) > g1.n*(g1.n-1);
-//    std::stable_sort(std::begin(vv0), std::end(vv0), [&](int a, int b) {
-//        return g1_dense ? (g0_deg[a]<g0_deg[b]) : (g0_deg[a]>g0_deg[b]);
-//    });
-//    vector<int> vv1(g1.n);
-//    std::iota(std::begin(vv1), std::end(vv1), 0);
-//    bool g0_dense = sum(g0_deg) > g0.n*(g0.n-1);
-//    std::stable_sort(std::begin(vv1), std::end(vv1), [&](int a, int b) {
-//        return g0_dense ? (g1_deg[a]<g1_deg[b]) : (g1_deg[a]>g1_deg[b]);
-//    });
-//
-//    struct Graph g0_sorted = induced_subgraph(g0, vv0);
-//    struct Graph g1_sorted = induced_subgraph(g1, vv1);
-
-    mcs(g0, g1);
+    g0_original_ids = renumber(g0);
+    g1_original_ids = renumber(g1);
+
+    if (arguments.output_thread)
+        solution_writer.start_thread();
+    if (arguments.binary)
+        solution_writer.start_binary();
+
+    OutputVisitor visitor;
+    McsplitResult result = run_search(g0, g1, options, visitor);
+    solution_writer.finish();
 
     auto stop = std::chrono::steady_clock::now();
     auto time_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
 
-    /* Clean up the timeout thread */
-    if (timeout_thread.joinable()) {
-        {
-            std::unique_lock<std::mutex> guard(timeout_mutex);
-            abort_due_to_timeout.store(true);
-            timeout_cv.notify_all();
-        }
-        timeout_thread.join();
+    /* Clean up the timeout and checkpoint threads */
+    {
+        std::unique_lock<std::mutex> guard(timeout_mutex);
+        abort_due_to_timeout.store(true);
+        timeout_cv.notify_all();
     }
+    if (timeout_thread.joinable())
+        timeout_thread.join();
+    if (checkpoint_thread.joinable())
+        checkpoint_thread.join();
+
+    // A checkpoint is only kept if the search was stopped before it finished
+    if (arguments.checkpoint_filename && !result.stopped)
+        remove(arguments.checkpoint_filename);
 
 ////    for (int i=0; i<g0.n; i++)
 ////        for (unsigned int j=0; j<solution.size(); j++)
@@ -440,10 +567,17 @@ int main(int argc, char** argv) {
 ////                cout << "(" << solution[j].v << " -> " << solution[j].w << ") ";
 ////    cout << std::endl;
 
-    cout << "Solutions:                  " << solution_count << endl;
-    cout << "Nodes:                      " << nodes << endl;
+    if (arguments.subtree)
+        cout << "Subtree:                    " << arguments.subtree << endl;
+    if (arguments.shard_count)
+        cout << "Shard:                      " << arguments.shard_index << "/"
+             << arguments.shard_count << endl;
+    cout << "Solutions:                  " << result.solutions << endl;
+    cout << "Nodes:                      " << result.nodes << endl;
     cout << "CPU time (ms):              " << time_elapsed << endl;
     if (aborted)
         cout << "TIMEOUT" << endl;
+    if (terminated)
+        cout << "TERMINATED" << endl;
 }
 
@@ -1,4 +1,6 @@
 #include "graph_implicit.h"
+#include "batch.h"
+#include "solution_writer.h"
 
 #include <algorithm>
 #include <numeric>
@@ -12,6 +14,8 @@
 #include <thread>
 #include <condition_variable>
 #include <atomic>
+#include <stdexcept>
+#include <deque>
 
 #include <argp.h>
 #include <limits.h>
@@ -35,25 +39,43 @@ enum Heuristic { min_max, min_product };
 *******************************************************************************/
 
 static char doc[] = "Find maximal common connected induced subgraphs";
-static char args_doc[] = "FILENAME1 FILENAME2";
+static char args_doc[] = "FILENAME1 FILENAME2\n--batch=MANIFEST";
 static struct argp_option options[] = {
     {"verbose", 'v', 0, 0, "Verbose output"},
     {"quiet", 'q', 0, 0, "Quiet output; this runs faster"},
     {"timeout", 't', "timeout", 0, "Specify a timeout (seconds)"},
+    {"batch", 'b', "manifest", 0, "Solve each pair of graphs listed in a manifest file; "
+            "this implies --quiet, and --timeout applies to each pair"},
+    {"threads", 'T', "threads", 0, "Number of pairs to solve at once in batch mode (default 1)"},
+    {"order", 'r', "order", 0, "Renumber the vertices of each graph before searching: "
+            "none (the default), degree or degeneracy; solutions are still printed "
+            "with the vertex numbers of the input files"},
+    {"output-thread", 'O', 0, 0, "Write solutions to stdout on a separate thread"},
+    {"binary", 'B', 0, 0, "Write solutions as a compact binary stream, which "
+            "utils/decode_solutions turns back into text"},
     { 0 }
 };
 
 static struct {
     bool verbose;
     bool quiet;
+    bool output_thread;
+    bool binary;
     char *filename1;
     char *filename2;
+    char *batch_filename;
     int timeout;
+    int threads;
+    VertexOrder order;
     int arg_num;
 } arguments;
 
 static std::atomic<bool> abort_due_to_timeout;
 
+// The flag that the search running on this thread checks.  In batch mode,
+// each pair has its own flag.
+thread_local std::atomic<bool> * abort_search = &abort_due_to_timeout;
+
 static error_t parse_opt (int key, char *arg, struct argp_state *state) {
     switch (key) {
         case 'v':
@@ -62,9 +84,34 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
         case 'q':
             arguments.quiet = true;
             break;
+        case 'O':
+            arguments.output_thread = true;
+            break;
+        case 'B':
+            arguments.binary = true;
+            break;
         case 't':
             arguments.timeout = std::stoi(arg);
             break;
+        case 'b':
+            arguments.batch_filename = arg;
+            arguments.quiet = true;
+            break;
+        case 'T':
+            arguments.threads = std::stoi(arg);
+            if (arguments.threads < 1)
+                fail("The number of threads must be at least 1");
+            break;
+        case 'r':
+            if (0 == strcmp(arg, "none"))
+                arguments.order = identity_order;
+            else if (0 == strcmp(arg, "degree"))
+                arguments.order = degree_order;
+            else if (0 == strcmp(arg, "degeneracy"))
+                arguments.order = degeneracy_order;
+            else
+                fail("The order must be none, degree or degeneracy");
+            break;
         case ARGP_KEY_ARG:
             if (arguments.arg_num == 0) {
                 arguments.filename1 = arg;
@@ -76,7 +123,7 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
             arguments.arg_num++;
             break;
         case ARGP_KEY_END:
-            if (arguments.arg_num == 0)
+            if (arguments.arg_num == 0 && !arguments.batch_filename)
                 argp_usage(state);
             break;
         default: return ARGP_ERR_UNKNOWN;
@@ -90,8 +137,9 @@ static struct argp argp = { options, parse_opt, args_doc, doc };
                                      Stats
 *******************************************************************************/
 
-unsigned long long nodes{ 0 };
-unsigned long long solution_count{ 0 };
+/* Counted per thread, so that pairs can be solved concurrently in batch mode */
+thread_local unsigned long long nodes{ 0 };
+thread_local unsigned long long solution_count{ 0 };
 
 /*******************************************************************************
                                  MCS functions
@@ -113,36 +161,71 @@ struct Bidomain {
     int X_count;
 };
 
+// Scratch space for the children of one search node: their domains, the
+// neighbours of v and w that are not yet in any domain, and the sorted right
+// set that is being branched on.  A SearchStack keeps one level for each
+// depth of the search, which successive siblings reuse, so that the search
+// stops allocating memory once it has reached its greatest depth.
+struct SearchLevel {
+    vector<Bidomain> domains;
+    vector<int> left;
+    vector<int> right;
+    vector<int> ws;
+};
+
+struct SearchStack {
+    std::deque<SearchLevel> levels;  // a deque, so that levels never move
+    unsigned int depth = 0;
+    SearchLevel & push() {
+        if (depth == levels.size())
+            levels.emplace_back();
+        return levels[depth++];
+    }
+    void pop() { --depth; }
+};
+
+// g0_original_ids[v] is the number in the input file of vertex v of the
+// renumbered g0, and likewise for g1; each is empty if its graph was not
+// renumbered.  See renumber().
+static vector<int> g0_original_ids;
+static vector<int> g1_original_ids;
+
+static int original(const vector<int> & original_ids, int v) {
+    return original_ids.empty() ? v : original_ids[v];
+}
+
 void show_current(const vector<VtxPair>& current)
 {
     ++solution_count;
     if (arguments.quiet) {
         return;
     }
-    for (unsigned int i=0; i<current.size(); i++) {
-        cout << "  (" << current[i].v << " " << current[i].w << ")";
-    }
-    cout << std::endl;
+    for (unsigned int i=0; i<current.size(); i++)
+        solution_writer.put_pair(original(g0_original_ids, current[i].v),
+                original(g1_original_ids, current[i].w));
+    solution_writer.end_line();
 }
 
 void show(const vector<VtxPair>& current, const vector<Bidomain> &domains)
 {
+    solution_writer.flush();
     cout << "Nodes: " << nodes << std::endl;
     cout << "Length of current assignment: " << current.size() << std::endl;
     cout << "Current assignment:";
     for (unsigned int i=0; i<current.size(); i++) {
-        cout << "  (" << current[i].v << " -> " << current[i].w << ")";
+        cout << "  (" << original(g0_original_ids, current[i].v) << " -> "
+             << original(g1_original_ids, current[i].w) << ")";
     }
     cout << std::endl;
     for (unsigned int i=0; i<domains.size(); i++) {
         struct Bidomain bd = domains[i];
         cout << "Left  ";
         for (Iter it=bd.l_start; it!=bd.l_end; it++)
-            cout << *it << " ";
+            cout << original(g0_original_ids, *it) << " ";
         cout << std::endl;
         cout << "Right  ";
         for (Iter it=bd.r_start; it!=bd.r_end; it++)
-            cout << *it << " ";
+            cout << original(g1_original_ids, *it) << " ";
         cout << std::endl;
     }
     cout << "\n" << std::endl;
@@ -162,17 +245,17 @@ bool check_sol(const Graph & g0, const Graph & g1 , const vector<VtxPair> & solu
             return false;
         for (unsigned int j=i+1; j<solution.size(); j++) {
             struct VtxPair p1 = solution[j];
-            if (g0.adjmat[p0.v][p1.v] != g1.adjmat[p0.w][p1.w])
+            if (g0.adjacent(p0.v, p1.v) != g1.adjacent(p0.w, p1.w))
                 return false;
         }
     }
     return true;
 }
 
-int find_and_remove_first_val(Bidomain & bd, vector<bool> & X) {
+int find_and_remove_first_val(Bidomain & bd, VertexSet & X) {
     for (Iter it=bd.l_start; it!=bd.l_end; it++) {
         int v = *it;
-        if (!X[v]) {
+        if (!X.contains(v)) {
             bd.l_end--;
             std::swap(*it, *bd.l_end);
             return v;
@@ -192,51 +275,65 @@ int select_bidomain(const vector<Bidomain>& domains)
     return -1;
 }
 
+// Returns the number of vertices in [start, end) that are in X
+int count_in_X(Iter start, Iter end, const VertexSet & X)
+{
+    int count = 0;
+    for (Iter it=start; it!=end; it++)
+        count += X.contains(*it);
+    return count;
+}
+
 // Returns iter to one-past-end of left part
-Iter partition(Iter start, Iter end, const vector<unsigned char> & adjrow) {
+Iter partition(Iter start, Iter end, const NeighbourMarker & neighbours) {
+    if (neighbours.row)
+        return std::partition(start, end,
+                [&](const int elem){ return neighbours.in_row(elem); });
     return std::partition(start, end,
-            [&](const int elem){ return 0 != adjrow[elem]; });
+            [&](const int elem){ return neighbours.stamped(elem); });
 }
 
-vector<Bidomain> filter_domains(const vector<Bidomain> & d, vector<int> & left,
-        vector<int> & right, const Graph & g0, const Graph & g1, int v, int w,
-        vector<bool> & X)
+// Sets new_d to the domains of the child that assigns v to w.  marks0 and
+// marks1 are scratch space for adjacency queries on g0 and g1.
+void filter_domains(const vector<Bidomain> & d, vector<Bidomain> & new_d,
+        vector<int> & left, vector<int> & right, const Graph & g0, const Graph & g1,
+        int v, int w, VertexSet & X, NeighbourMarker & marks0, NeighbourMarker & marks1)
 {
-    vector<Bidomain> new_d;
-    new_d.reserve(d.size());
+    new_d.clear();
+    if (!d.empty()) {
+        marks0.mark(g0, v);
+        marks1.mark(g1, w);
+    }
     for (const Bidomain &old_bd : d) {
-        Iter l_middle = partition(old_bd.l_start, old_bd.l_end, g0.adjmat[v]);
-        Iter r_middle = partition(old_bd.r_start, old_bd.r_end, g1.adjmat[w]);
+        Iter l_middle = partition(old_bd.l_start, old_bd.l_end, marks0);
+        Iter r_middle = partition(old_bd.r_start, old_bd.r_end, marks1);
+        // old_bd.X_count is split between the two halves, so only the X
+        // vertices in the smaller half of the left set need to be counted
+        int X_count_edge = 0;
+        if (old_bd.X_count) {
+            if (l_middle - old_bd.l_start <= old_bd.l_end - l_middle)
+                X_count_edge = count_in_X(old_bd.l_start, l_middle, X);
+            else
+                X_count_edge = old_bd.X_count - count_in_X(l_middle, old_bd.l_end, X);
+        }
         if (l_middle != old_bd.l_end && r_middle != old_bd.r_end) {
-            int X_count = 0;
-            for (Iter it=l_middle; it!=old_bd.l_end; it++) {
-                X_count += X[*it];
-            }
-            new_d.push_back({l_middle, r_middle, old_bd.l_end, old_bd.r_end, X_count});
+            new_d.push_back({l_middle, r_middle, old_bd.l_end, old_bd.r_end, old_bd.X_count - X_count_edge});
         }
         if (old_bd.l_start != l_middle && old_bd.r_start != r_middle) {
-            int X_count = 0;
-            for (Iter it=old_bd.l_start; it!=l_middle; it++) {
-                X_count += X[*it];
-            }
-            new_d.push_back({old_bd.l_start, old_bd.r_start, l_middle, r_middle, X_count});
+            new_d.push_back({old_bd.l_start, old_bd.r_start, l_middle, r_middle, X_count_edge});
         }
     }
-    return new_d;
 }
 
+// left and right must be sorted by label, as they are if they were taken in
+// order from neighbour lists
 void add_adjacent_label_classes(vector<Bidomain> & new_d,
         vector<int> & left, vector<int> & right, const Graph & g0, const Graph & g1,
-        vector<bool> & X)
+        VertexSet & X)
 {
     if (left.empty() || right.empty()) {
         return;
     }
-    std::sort(left.begin(), left.end(), [&](int a, int b)
-            { return g0.label[a] < g0.label[b]; });
-    std::sort(right.begin(), right.end(), [&](int a, int b)
-            { return g1.label[a] < g1.label[b]; });
-
     auto l = left.begin();
     auto r = right.begin();
     while (l!=left.end() && r!=right.end()) {
@@ -251,9 +348,7 @@ void add_adjacent_label_classes(vector<Bidomain> & new_d,
             auto lmin = l;
             auto rmin = r;
             do {
-                if (X[*l]) {
-                    ++X_count;   // TODO: avoid branch?
-                }
+                X_count += X.contains(*l);
                 l++;
             } while (l!=left.end() && g0.label[*l]==left_label);
             do { r++; } while (r!=right.end() && g1.label[*r]==left_label);
@@ -262,41 +357,26 @@ void add_adjacent_label_classes(vector<Bidomain> & new_d,
     }
 }
 
-// returns and Iter to the smallest value in arr that is >w.
-// Assumption: such a value exists
-// Assumption: arr contains no duplicates
-// Assumption: arr does not contain INT_MAX
-Iter iter_to_next_smallest(Iter start, Iter end, int w) {
-    Iter retval;
-    int smallest = INT_MAX;
-    for (Iter it=start; it!=end; it++) {
-        if (*it>w && *it<smallest) {
-            smallest = *it;
-            retval=it;
-        }
-    }
-    return retval;
-}
-
-void set_all(const vector<int> & vals, vector<bool> & bools)
+void set_all(const vector<int> & vals, VertexSet & set)
 {
     for (int v : vals) {
-        bools[v] = true;
+        set.insert(v);
     }
 }
 
-void unset_all(const vector<int> & vals, vector<bool> & bools)
+void unset_all(const vector<int> & vals, VertexSet & set)
 {
     for (int v : vals) {
-        bools[v] = false;
+        set.erase(v);
     }
 }
 
 void solve(const Graph & g0, const Graph & g1,
         vector<VtxPair> & current, vector<Bidomain> & domains,
-        vector<bool> & X, vector<bool> & D_G, vector<bool> & D_H)
+        VertexSet & X, VertexSet & D_G, VertexSet & D_H,
+        NeighbourMarker & marks0, NeighbourMarker & marks1, SearchStack & stack)
 {
-    if (abort_due_to_timeout)
+    if (*abort_search)
         return;
 
     if (arguments.verbose) show(current, domains);
@@ -315,50 +395,55 @@ void solve(const Graph & g0, const Graph & g1,
 
     int v = find_and_remove_first_val(bd, X);
 
-    // Try assigning v to each vertex w beginning at bd.r, in turn
-    int w = -1;
-    bd.r_end--;
-    int num_r_vals = bd.r_end - bd.r_start;
-
-    vector<int> left;
-    vector<int> right;
-    for (int u : g0.adjlists[v]) {
-        if (D_G[u]) {
+    SearchLevel & level = stack.push();
+    vector<Bidomain> & new_domains = level.domains;
+    vector<int> & left = level.left;
+    vector<int> & right = level.right;
+    left.clear();
+    for (int u : g0.adjlist(v)) {
+        if (D_G.contains(u)) {
             left.push_back(u);
-            D_G[u] = false;
+            D_G.erase(u);
         }
     }
 
-    for (int i=0; i<=num_r_vals; i++) {
-        Iter iter = iter_to_next_smallest(bd.r_start, bd.r_end+1, w);
-        w = *iter;
-
-        // swap w to the end of its colour class
-        *iter = *bd.r_end;
+    // Try assigning v to each vertex w in bd's right set, in increasing order.
+    // The children permute the set, so before each child it is rewritten from
+    // a sorted copy, with w at the end.
+    vector<int> & ws = level.ws;
+    ws.assign(bd.r_start, bd.r_end);
+    std::sort(ws.begin(), ws.end());
+    bd.r_end--;
+    for (unsigned int i=0; i<ws.size(); i++) {
+        int w = ws[i];
+        std::copy(ws.begin(), ws.begin() + i, bd.r_start);
+        std::copy(ws.begin() + i + 1, ws.end(), bd.r_start + i);
         *bd.r_end = w;
 
         right.clear();
-        for (int u : g1.adjlists[w]) {
-            if (D_H[u]) {
+        for (int u : g1.adjlist(w)) {
+            if (D_H.contains(u)) {
                 right.push_back(u);
-                D_H[u] = false;
+                D_H.erase(u);
             }
         }
 
-        auto new_domains = filter_domains(domains, left, right, g0, g1, v, w, X);
+        filter_domains(domains, new_domains, left, right, g0, g1, v, w, X,
+                marks0, marks1);
         add_adjacent_label_classes(new_domains, left, right, g0, g1, X);
         current.push_back(VtxPair(v, w));
-        solve(g0, g1, current, new_domains, X, D_G, D_H);
+        solve(g0, g1, current, new_domains, X, D_G, D_H, marks0, marks1, stack);
         current.pop_back();
         set_all(right, D_H);
     }
     set_all(left, D_G);
+    stack.pop();
     bd.l_end++;
     bd.r_end++;
-    X[v] = true;
+    X.insert(v);
     ++bd.X_count;
-    solve(g0, g1, current, domains, X, D_G, D_H);
-    X[v] = false;
+    solve(g0, g1, current, domains, X, D_G, D_H, marks0, marks1, stack);
+    X.erase(v);
 }
 
 void start_search(const Graph & g0, const Graph & g1,
@@ -370,31 +455,34 @@ void start_search(const Graph & g0, const Graph & g1,
         show_current(current);
         return;
     }
-    vector<bool> X(g0.n);
-    vector<bool> D_G(g0.n, true);
-    vector<bool> D_H(g1.n, true);
+    VertexSet X(g0.n);
+    VertexSet D_G(g0.n, true);
+    VertexSet D_H(g1.n, true);
+    NeighbourMarker marks0(g0.n);
+    NeighbourMarker marks1(g1.n);
+    SearchStack stack;
     for (Bidomain & bd : domains) {
         for (Iter it=bd.l_start; it!=bd.l_end; it++) {
             int v = *it;
-            auto left = g0.adjlists[v];
-            D_G[v] = false;
+            vector<int> left(g0.adjlist(v).begin(), g0.adjlist(v).end());
+            D_G.erase(v);
             unset_all(left, D_G);
             for (Iter it=bd.r_start; it!=bd.r_end; it++) {
                 int w = *it;
-                auto right = g1.adjlists[w];
-                D_H[w] = false;
+                vector<int> right(g1.adjlist(w).begin(), g1.adjlist(w).end());
+                D_H.erase(w);
                 unset_all(right, D_H);
                 vector<Bidomain> domains;
                 add_adjacent_label_classes(domains, left, right, g0, g1, X);
                 current.push_back(VtxPair(v, w));
-                solve(g0, g1, current, domains, X, D_G, D_H);
+                solve(g0, g1, current, domains, X, D_G, D_H, marks0, marks1, stack);
                 current.pop_back();
-                D_H[w] = true;
+                D_H.insert(w);
                 set_all(right, D_H);
             }
-            D_G[v] = true;
+            D_G.insert(v);
             set_all(left, D_G);
-            X[v] = true;
+            X.insert(v);
         }
     }
 }
@@ -436,27 +524,55 @@ void mcs(const Graph & g0, const Graph & g1) {
     start_search(g0, g1, domains);
 }
 
-vector<int> calculate_degrees(const Graph & g) {
-    vector<int> degree(g.n, 0);
-    for (int v=0; v<g.n; v++) {
-        for (int w=0; w<g.n; w++) {
-            unsigned int mask = 0xFFFFu;
-            if (g.adjmat[v][w] & mask) degree[v]++;
-            if (g.adjmat[v][w] & ~mask) degree[v]++;  // inward edge, in directed case
-        }
+// Renumbers the vertices of g in the order given by --order, and returns
+// the old number of each new vertex, or nothing if g is left as it is
+vector<int> renumber(Graph & g) {
+    if (arguments.order == identity_order)
+        return {};
+    vector<int> original_ids = vertex_order(g, arguments.order);
+    g = induced_subgraph(g, original_ids);
+    return original_ids;
+}
+
+// Reads a graph for a single search, failing if it cannot
+Graph read_graph_or_fail(const char* filename) {
+    try {
+        return readGraph(filename);
+    } catch (const std::exception & e) {
+        fail(e.what());
+        throw;
     }
-    return degree;
 }
 
-int sum(const vector<int> & vec) {
-    return std::accumulate(std::begin(vec), std::end(vec), 0);
+PairStats solve_pair(const char* filename1, const char* filename2,
+        std::atomic<bool> & abort)
+{
+    abort_search = &abort;
+    nodes = 0;
+    solution_count = 0;
+    struct Graph g0 = readGraph(filename1);
+    struct Graph g1 = readGraph(filename2);
+    // Batch mode prints no solutions, so the old numbers are not needed
+    renumber(g0);
+    renumber(g1);
+    mcs(g0, g1);
+    return {solution_count, nodes};
 }
 
 int main(int argc, char** argv) {
+    arguments.threads = 1;
     argp_parse(&argp, argc, argv, 0, 0, 0);
 
-    struct Graph g0 = readGraph(arguments.filename1);
-    struct Graph g1 = readGraph(arguments.filename2);
+    if (arguments.binary && arguments.verbose)
+        fail("Binary output cannot be used with --verbose");
+
+    if (arguments.batch_filename) {
+        return run_batch(arguments.batch_filename, arguments.threads, arguments.timeout,
+                solve_pair) ? 1 : 0;
+    }
+
+    struct Graph g0 = read_graph_or_fail(arguments.filename1);
+    struct Graph g1 = read_graph_or_fail(arguments.filename2);
 
     std::thread timeout_thread;
     std::mutex timeout_mutex;
@@ -485,7 +601,16 @@ int main(int argc, char** argv) {
 
     auto start = std::chrono::steady_clock::now();
 
+    g0_original_ids = renumber(g0);
+    g1_original_ids = renumber(g1);
+
+    if (arguments.output_thread)
+        solution_writer.start_thread();
+    if (arguments.binary)
+        solution_writer.start_binary();
+
     mcs(g0, g1);
+    solution_writer.finish();
 
     auto stop = std::chrono::steady_clock::now();
     auto time_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
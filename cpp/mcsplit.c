@@ -0,0 +1,1422 @@
+#include "mcsplit.h"
+#include "partition.h"
+
+#include <algorithm>
+#include <numeric>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <limits>
+#include <deque>
+#include <list>
+#include <memory>
+#include <stdexcept>
+
+#include <limits.h>
+#include <stdlib.h>
+
+using std::vector;
+
+/*******************************************************************************
+                                 MCS functions
+*******************************************************************************/
+
+// The type of the vertex indices in the left and right buffers, and of the
+// offsets and lengths of bidomains.  Building with -DSMALL_VERTEX_IDS halves
+// the size of the buffers and of each bidomain, but limits each graph to
+// 65535 vertices.
+#ifdef SMALL_VERTEX_IDS
+typedef uint16_t VtxIdx;
+#else
+typedef int VtxIdx;
+#endif
+
+struct Bidomain {
+    VtxIdx l, r;        // start indices of left and right sets
+    VtxIdx left_len, right_len;
+    bool is_adjacent;
+    VtxIdx X_count;
+    Bidomain(int l, int r, int left_len, int right_len, bool is_adjacent, int X_count):
+            l(l),
+            r(r),
+            left_len (left_len),
+            right_len (right_len),
+            is_adjacent (is_adjacent),
+            X_count (X_count) { };
+};
+
+// The connected, verbose and quiet options, as constants, so that each
+// combination of them gets its own copy of the search, in which the tests of
+// the options are resolved at compile time.  mcsplit() chooses the copy.
+template <bool Connected, bool Verbose, bool Quiet>
+struct SearchFlags {
+    static constexpr bool connected = Connected;
+    static constexpr bool verbose = Verbose;
+    static constexpr bool quiet = Quiet;
+};
+
+bool check_sol(const Graph & g0, const Graph & g1 , const vector<VtxPair> & solution) {
+    return true;
+    vector<bool> used_left(g0.n, false);
+    vector<bool> used_right(g1.n, false);
+    for (unsigned int i=0; i<solution.size(); i++) {
+        struct VtxPair p0 = solution[i];
+        if (used_left[p0.v] || used_right[p0.w])
+            return false;
+        used_left[p0.v] = true;
+        used_right[p0.w] = true;
+        if (g0.label[p0.v] != g1.label[p0.w])
+            return false;
+        for (unsigned int j=i+1; j<solution.size(); j++) {
+            struct VtxPair p1 = solution[j];
+            if (g0.adjacent(p0.v, p1.v) != g1.adjacent(p0.w, p1.w))
+                return false;
+        }
+    }
+    return true;
+}
+
+// Removes and returns the smallest vertex in the left part of bd that is
+// not in X.  Taking the smallest, rather than the first, makes the search
+// tree independent of the order of the buffers.
+static int find_and_remove_first_val(Bidomain & bd, vector<VtxIdx> & left, VertexSet & X) {
+    VtxIdx *arr = left.data() + bd.l;
+    int best = -1;
+    for (int i=0; i<bd.left_len; i++) {
+        if (!X.contains(arr[i]) && (best == -1 || arr[i] < arr[best])) {
+            best = i;
+        }
+    }
+    if (best == -1)
+        return -1;
+    int v = arr[best];
+    bd.left_len--;
+    std::swap(arr[best], arr[bd.left_len]);
+    return v;
+}
+
+template <typename Flags>
+static int select_bidomain(const vector<Bidomain>& domains, int current_matching_size)
+{
+    for (unsigned int i=0; i<domains.size(); i++) {
+        const Bidomain &bd = domains[i];
+        if (bd.left_len == bd.X_count)
+            continue;
+        if (Flags::connected && current_matching_size>0 && !bd.is_adjacent)
+            continue;
+        return i;
+    }
+    return -1;
+}
+
+// Whether the solutions below a node must have fewer than min_size pairs.
+// Each bidomain can add at most as many pairs as the smaller of its right set
+// and the part of its left set that is not in X.
+static bool below_min_size(const vector<Bidomain> & domains, unsigned int current_size,
+        unsigned int min_size)
+{
+    unsigned int bound = current_size;
+    for (const Bidomain & bd : domains) {
+        if (bound >= min_size)
+            return false;
+        bound += std::min(bd.left_len - bd.X_count, (int) bd.right_len);
+    }
+    return bound < min_size;
+}
+
+// Returns the number of vertices in arr[0..len) that are in X
+static int count_in_X(const VtxIdx *arr, int len, const VertexSet & X)
+{
+    int count = 0;
+    for (int i=0; i<len; i++)
+        count += X.contains(arr[i]);
+    return count;
+}
+
+// The fastest partition kernel that this CPU supports, if it has one
+static PartitionKernel partition_kernel = best_partition_kernel();
+
+// Moves the vertices in arr[0..len) whose bits are set in adjrow to the front
+// of arr, and returns how many there are.  If X is not null, X_count is set
+// to the number of these that are in X.  scratch is grown as the kernels
+// need.
+static int partition(VtxIdx *arr, int len, const uint64_t *adjrow,
+        const VertexSet *X, int & X_count, vector<int> & scratch)
+{
+#ifndef SMALL_VERTEX_IDS
+    // The kernels take 32-bit vertex indices, and only pay off on longer
+    // arrays
+    if (partition_kernel && len >= 32) {
+        if (scratch.size() < (unsigned int) len)
+            scratch.resize(len);
+        return partition_kernel(arr, len, adjrow, X ? X->words.data() : nullptr,
+                &X_count, scratch.data());
+    }
+#endif
+    int count = std::partition(arr, arr + len,
+            [&](const VtxIdx elem){ return (adjrow[elem >> 6] >> (elem & 63)) & 1; }) - arr;
+    if (X)
+        X_count = count_in_X(arr, count, *X);
+    return count;
+}
+
+// Sets new_d to the domains of the child that assigns v to w
+static void filter_domains(const vector<Bidomain> & d, vector<Bidomain> & new_d,
+        vector<VtxIdx> & left, vector<VtxIdx> & right,
+        const Graph & g0, const Graph & g1, int v, int w,
+        VertexSet & X, vector<int> & scratch)
+{
+    new_d.clear();
+    for (const Bidomain &old_bd : d) {
+        int l = old_bd.l;
+        int r = old_bd.r;
+        // The X vertices are counted while partitioning the left set, unless
+        // there are none
+        int X_count_edge = 0;
+        int left_len = partition(left.data() + l, old_bd.left_len, g0.adjrow(v),
+                old_bd.X_count ? &X : nullptr, X_count_edge, scratch);
+        int right_len = partition(right.data() + r, old_bd.right_len, g1.adjrow(w),
+                nullptr, X_count_edge, scratch);
+        int left_len_noedge = old_bd.left_len - left_len;
+        int right_len_noedge = old_bd.right_len - right_len;
+        if (left_len_noedge && right_len_noedge) {
+            new_d.push_back({l+left_len, r+right_len, left_len_noedge, right_len_noedge,
+                    old_bd.is_adjacent, old_bd.X_count - X_count_edge});
+        }
+        if (left_len && right_len) {
+            new_d.push_back({l, r, left_len, right_len, true, X_count_edge});
+        }
+    }
+}
+
+/*******************************************************************************
+                                Ordered output
+*******************************************************************************/
+
+// With ordered, the solutions found below each branch of a shared node are
+// buffered in an OutputSegment, and a sequencer thread passes the segments to
+// the visitor in the order in which a single thread would have found the
+// solutions.
+
+struct OutputSegment;
+
+// A run of solutions, or the output of the branches of a shared node.  Each
+// solution is stored as its number of pairs followed by the pairs.
+struct OutputItem {
+    vector<int> solutions;
+    vector<std::shared_ptr<OutputSegment>> branches;
+};
+
+// The output of a branch of the search, which is produced by the one thread
+// exploring the branch, and consumed from the front by the sequencer
+struct OutputSegment {
+    std::deque<OutputItem> items;
+    bool finished = false;
+};
+
+// Producers block once this many ints are buffered, unless they are writing
+// the segment that the sequencer is waiting for
+const size_t ordered_output_buffer_limit = 16 << 20;
+
+// Solutions are buffered per thread, and moved to the thread's segment in
+// chunks of this many ints
+const size_t ordered_output_chunk_size = 1024;
+
+struct OrderedOutput {
+    std::mutex mutex;
+    std::condition_variable sequencer_cv;
+    std::condition_variable producer_cv;
+    OutputSegment * head = nullptr;
+    size_t buffered_size = 0;
+};
+
+/*******************************************************************************
+                                 Shared state
+*******************************************************************************/
+
+// A copy of a search node, taken after v has been removed from the left side
+// of bidomain bd_idx, whose branches may be explored by any thread.  Branch i
+// assigns v to ws[i] for i < ws.size(); the final branch adds v to X.
+struct SharedNode {
+    vector<VtxPair> current;
+    vector<VtxIdx> left;
+    vector<VtxIdx> right;
+    vector<Bidomain> domains;
+    VertexSet X;
+    int bd_idx;
+    int v;
+    vector<int> ws;
+    unsigned int depth;
+    unsigned long long path_hash;
+    vector<std::shared_ptr<OutputSegment>> output_branches;  // with ordered
+    std::atomic<unsigned int> next_branch{ 0 };
+};
+
+// Branch i of a search node assigns v to the i-th smallest w in its domain,
+// and the last branch adds v to X.  Since the search tree does not depend on
+// the order in which branches are explored, a node can be named by the path
+// of branch numbers that leads to it from the root.
+//
+// With a subtree path, only the branches on the path are taken until the end
+// of the path is reached, and nodes on the path are not counted.  With
+// shards, every shard visits the nodes above shard_depth but only shard 0
+// counts them, and each node at shard_depth belongs to the shard given by a
+// hash of its path.
+//
+// A checkpoint names the node at which the search would have continued, by
+// its path, and records the numbers of nodes and solutions counted before it.
+// Every node to its left has been fully explored, and the nodes on its path
+// have been visited.  On resuming, the search descends straight to it,
+// starting each node on the path at the branch that the path takes, and
+// carries on from there without counting the nodes on the path again.  The
+// domains and X are rebuilt on the way down, so they need not be saved.
+
+const unsigned long long root_path_hash = 14695981039346656037ull;
+
+static unsigned long long child_path_hash(unsigned long long path_hash, int branch)
+{
+    return (path_hash ^ (branch + 1)) * 1099511628211ull;
+}
+
+// The state of a search that is shared by all of its threads
+struct SharedSearch {
+    const Graph & g0;
+    const Graph & g1;
+    const McsplitOptions & options;
+    McsplitVisitor & visitor;
+    std::mutex visitor_mutex;
+
+    const std::atomic<bool> & abort;
+    unsigned int shard_depth;
+
+    // Whether a node has been reached since the search was stopped
+    std::atomic<bool> stopped{ false };
+
+    // With stop_at_first, whether the first solution has been found
+    std::atomic<bool> decided{ false };
+
+    // The depth of the next node on options.resume_path for the search to
+    // visit
+    unsigned int resume_depth = 0;
+
+    // The counts of the threads that have finished
+    std::mutex stats_mutex;
+    unsigned long long total_nodes = 0;
+    unsigned long long total_solution_count = 0;
+
+    // Nodes whose branches may not all have been taken yet, oldest first
+    struct {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::list<std::shared_ptr<SharedNode>> nodes;
+        int busy_threads = 0;
+    } shared_nodes;
+
+    OrderedOutput ordered_output;
+
+    SharedSearch(const Graph & g0, const Graph & g1, const McsplitOptions & options,
+            McsplitVisitor & visitor, const std::atomic<bool> & abort) :
+            g0(g0), g1(g1), options(options), visitor(visitor), abort(abort),
+            shard_depth(options.subtree_path.size() + options.split_depth)
+    {
+    }
+
+    bool counts_node(unsigned int depth) const
+    {
+        if (depth < options.subtree_path.size())
+            return false;
+        return options.shard_count == 0 || options.shard_index == 0 || depth >= shard_depth;
+    }
+
+    bool in_shard(unsigned int depth, unsigned long long path_hash) const
+    {
+        return options.shard_count == 0 || depth != shard_depth ||
+                path_hash % options.shard_count == (unsigned int) options.shard_index;
+    }
+
+    bool explores_branch(unsigned int depth, int branch, int branch_count) const
+    {
+        if (depth >= options.subtree_path.size())
+            return true;
+        int path_branch = options.subtree_path[depth];
+        return path_branch == branch || (path_branch == -1 && branch == branch_count - 1);
+    }
+
+    bool on_resume_path(unsigned int depth) const
+    {
+        return depth == resume_depth && depth < options.resume_path.size();
+    }
+
+    // Returns the branch at which the node at depth on the path being resumed
+    // starts, given its number of branches
+    unsigned int resume_branch(unsigned int depth, unsigned int branch_count)
+    {
+        int branch = options.resume_path[depth] == -1 ? branch_count - 1 : options.resume_path[depth];
+        if (branch >= (int) branch_count)
+            throw std::runtime_error("The checkpoint does not match this search");
+        ++resume_depth;
+        return branch;
+    }
+
+    void add_thread_stats_to_totals(unsigned long long nodes, unsigned long long solution_count)
+    {
+        std::lock_guard<std::mutex> guard(stats_mutex);
+        total_nodes += nodes;
+        total_solution_count += solution_count;
+    }
+
+    void run_sequencer(std::shared_ptr<OutputSegment> root);
+};
+
+// Passes the solutions in the segments below root to the visitor, in order,
+// until root is finished
+void SharedSearch::run_sequencer(std::shared_ptr<OutputSegment> root)
+{
+    // Each segment in the stack except the top is waiting for the branches
+    // at the front of its items; next_branch holds the index of the branch
+    // in progress for each of these
+    vector<std::shared_ptr<OutputSegment>> stack { root };
+    vector<unsigned int> next_branch;
+    vector<VtxPair> solution;
+    std::unique_lock<std::mutex> guard(ordered_output.mutex);
+    while (!stack.empty()) {
+        OutputSegment * segment = stack.back().get();
+        if (ordered_output.head != segment) {
+            ordered_output.head = segment;
+            ordered_output.producer_cv.notify_all();
+        }
+        if (!segment->items.empty() && segment->items.front().branches.empty()) {
+            vector<int> solutions;
+            solutions.swap(segment->items.front().solutions);
+            segment->items.pop_front();
+            ordered_output.buffered_size -= solutions.size();
+            ordered_output.producer_cv.notify_all();
+            guard.unlock();
+            {
+                std::lock_guard<std::mutex> visitor_guard(visitor_mutex);
+                for (size_t i=0; i<solutions.size(); ) {
+                    solution.clear();
+                    int size = solutions[i++];
+                    for (int j=0; j<size; j++, i+=2)
+                        solution.push_back(VtxPair(solutions[i], solutions[i+1]));
+                    visitor.solution(solution);
+                }
+            }
+            guard.lock();
+        } else if (!segment->items.empty()) {
+            next_branch.push_back(0);
+            stack.push_back(segment->items.front().branches[0]);
+        } else if (segment->finished) {
+            stack.pop_back();
+            if (stack.empty())
+                break;
+            auto & branches = stack.back()->items.front().branches;
+            if (++next_branch.back() < branches.size()) {
+                stack.push_back(branches[next_branch.back()]);
+            } else {
+                stack.back()->items.pop_front();
+                next_branch.pop_back();
+            }
+        } else {
+            ordered_output.sequencer_cv.wait(guard);
+        }
+    }
+    ordered_output.head = nullptr;
+}
+
+/*******************************************************************************
+                                 Search threads
+*******************************************************************************/
+
+// Scratch space for the children of the nodes at each depth: their domains,
+// and the sorted right set that is being branched on.  Successive siblings
+// reuse it, so that the search stops allocating memory once it has reached
+// its greatest depth.
+struct SearchLevel {
+    vector<Bidomain> domains;
+    vector<VtxIdx> ws;
+};
+
+// The search is iterative.  Each node whose branches are being explored has
+// a frame on a stack, so that the depth of the search is not limited by the
+// size of the thread's call stack.  Branch i < ws.size() of a frame's node
+// assigns v to search_level(depth).ws[i]; the final branch adds v to X.
+struct SearchFrame {
+    vector<Bidomain> * domains;
+    int bd_idx;
+    int v;
+    unsigned int depth;
+    unsigned long long path_hash;
+    unsigned int next_branch;
+    bool in_assignment;  // whether the last branch taken pushed to current
+};
+
+// The state of one thread of a search
+template <typename Flags>
+struct SearchThread {
+    SharedSearch & shared;
+    const Graph & g0;
+    const Graph & g1;
+
+    // This thread's counts, which are added to the totals when it finishes
+    unsigned long long nodes = 0;
+    unsigned long long solution_count = 0;
+
+    std::deque<SearchLevel> search_levels;
+
+    // Each node on the stack takes a vertex of g0 that is not in X and does
+    // not give it back until the node is popped, so the stack never holds
+    // more than g0.n + 1 frames
+    vector<SearchFrame> search_frames;
+
+    vector<int> partition_scratch;
+
+    // The segment to which this thread's solutions belong, or null if
+    // solutions are passed to the visitor as soon as they are found
+    OutputSegment * output_segment = nullptr;
+    vector<int> output_chunk;
+
+    // For McsplitGenerator: whether to stop exploring frames after each
+    // solution, and whether a solution has been found since the search
+    // last stopped
+    bool pause_at_solutions = false;
+    bool paused = false;
+
+    explicit SearchThread(SharedSearch & shared) :
+            shared(shared), g0(shared.g0), g1(shared.g1)
+    {
+    }
+
+    SearchLevel & search_level(unsigned int depth)
+    {
+        while (search_levels.size() <= depth)
+            search_levels.emplace_back();
+        return search_levels[depth];
+    }
+
+    /*** Output ***/
+
+    // Moves this thread's buffered solutions to the end of its segment.  The
+    // mutex must be held.
+    void move_chunk_to_segment()
+    {
+        if (output_chunk.empty())
+            return;
+        auto & ordered_output = shared.ordered_output;
+        auto & items = output_segment->items;
+        if (items.empty() || !items.back().branches.empty())
+            items.push_back(OutputItem());
+        auto & solutions = items.back().solutions;
+        solutions.insert(solutions.end(), output_chunk.begin(), output_chunk.end());
+        ordered_output.buffered_size += output_chunk.size();
+        output_chunk.clear();
+        if (output_segment == ordered_output.head)
+            ordered_output.sequencer_cv.notify_one();
+    }
+
+    void write_ordered(const vector<VtxPair> & current)
+    {
+        output_chunk.push_back(current.size());
+        for (const VtxPair & pair : current) {
+            output_chunk.push_back(pair.v);
+            output_chunk.push_back(pair.w);
+        }
+        if (output_chunk.size() < ordered_output_chunk_size)
+            return;
+        auto & ordered_output = shared.ordered_output;
+        std::unique_lock<std::mutex> guard(ordered_output.mutex);
+        while (ordered_output.buffered_size > ordered_output_buffer_limit &&
+                output_segment != ordered_output.head && !shared.abort)
+            ordered_output.producer_cv.wait(guard);
+        move_chunk_to_segment();
+    }
+
+    // Appends to this thread's segment the output of the branches of a shared
+    // node, and returns the segments for the branches
+    vector<std::shared_ptr<OutputSegment>> add_output_branches(unsigned int branch_count)
+    {
+        auto & ordered_output = shared.ordered_output;
+        std::lock_guard<std::mutex> guard(ordered_output.mutex);
+        move_chunk_to_segment();
+        OutputItem item;
+        for (unsigned int i=0; i<branch_count; i++)
+            item.branches.push_back(std::make_shared<OutputSegment>());
+        output_segment->items.push_back(item);
+        if (output_segment == ordered_output.head)
+            ordered_output.sequencer_cv.notify_one();
+        return item.branches;
+    }
+
+    // Directs this thread's solutions to segment, and returns the segment
+    // that they were previously directed to
+    OutputSegment * start_output_segment(OutputSegment * segment)
+    {
+        OutputSegment * previous = output_segment;
+        output_segment = segment;
+        return previous;
+    }
+
+    // Marks this thread's segment as finished, and directs its solutions back
+    // to the segment previous
+    void finish_output_segment(OutputSegment * previous)
+    {
+        auto & ordered_output = shared.ordered_output;
+        {
+            std::lock_guard<std::mutex> guard(ordered_output.mutex);
+            move_chunk_to_segment();
+            output_segment->finished = true;
+            if (output_segment == ordered_output.head)
+                ordered_output.sequencer_cv.notify_one();
+        }
+        output_segment = previous;
+    }
+
+    void show_current(const vector<VtxPair>& current)
+    {
+        if (shared.options.stop_at_first && shared.decided.exchange(true))
+            return;
+        ++solution_count;
+        if (Flags::quiet) {
+            return;
+        }
+        if (output_segment) {
+            write_ordered(current);
+            return;
+        }
+        std::lock_guard<std::mutex> guard(shared.visitor_mutex);
+        shared.visitor.solution(current);
+        paused = pause_at_solutions;
+    }
+
+    void show(const vector<VtxPair>& current, const vector<Bidomain> &domains,
+            const vector<VtxIdx> & left, const vector<VtxIdx> & right)
+    {
+        vector<vector<int>> left_sets;
+        vector<vector<int>> right_sets;
+        for (const Bidomain & bd : domains) {
+            left_sets.emplace_back(left.begin() + bd.l, left.begin() + bd.l + bd.left_len);
+            right_sets.emplace_back(right.begin() + bd.r, right.begin() + bd.r + bd.right_len);
+        }
+        std::lock_guard<std::mutex> guard(shared.visitor_mutex);
+        shared.visitor.node(nodes, current, left_sets, right_sets);
+    }
+
+    /*** Checkpoints ***/
+
+    // Called at each node that the search reaches after it has been stopped;
+    // the first of these is where the search will continue.  A checkpoint is
+    // only taken if checkpoint_due is set, which needs a single thread.
+    void stopped_at(const vector<int> & path)
+    {
+        if (!shared.stopped.exchange(true) && shared.options.checkpoint_due)
+            shared.visitor.checkpoint(path, solution_count, nodes);
+    }
+
+    // Whether checkpoint_due has been set since the last checkpoint was taken
+    bool checkpoint_due()
+    {
+        auto checkpoint_due = shared.options.checkpoint_due;
+        if (!checkpoint_due || !checkpoint_due->load(std::memory_order_relaxed))
+            return false;
+        *checkpoint_due = false;
+        return true;
+    }
+
+    // The path of the node being started, from the branches that the frames
+    // on the stack have taken
+    vector<int> frame_path()
+    {
+        vector<int> path;
+        for (const SearchFrame & frame : search_frames) {
+            unsigned int branch = frame.next_branch - 1;
+            path.push_back(branch == search_level(frame.depth).ws.size() ? -1 : (int) branch);
+        }
+        return path;
+    }
+
+    /*** Parallel search ***/
+
+    // Explores one branch of a node from whose bidomain bd_idx v has been
+    // removed: v is assigned to w, or v is added to X if w is -1.  The node's
+    // domains are left as they were found.  path_hash is that of the branch.
+    void solve_branch(vector<VtxPair> & current, vector<Bidomain> & domains,
+            VertexSet & X, vector<VtxIdx> & left, vector<VtxIdx> & right,
+            unsigned int depth, unsigned long long path_hash, int bd_idx, int v, int w)
+    {
+        Bidomain &bd = domains[bd_idx];
+        if (w == -1) {
+            bd.left_len++;
+            X.insert(v);
+            ++bd.X_count;
+            solve(current, domains, X, left, right, depth + 1, path_hash);
+            --domains[bd_idx].X_count;
+            X.erase(v);
+            domains[bd_idx].left_len--;
+            return;
+        }
+
+        // swap w to the end of its colour class
+        VtxIdx *right_vals = right.data() + bd.r;
+        VtxIdx *w_ptr = std::find(right_vals, right_vals + bd.right_len, w);
+        bd.right_len--;
+        *w_ptr = right_vals[bd.right_len];
+        right_vals[bd.right_len] = w;
+
+        auto & new_domains = search_level(depth).domains;
+        filter_domains(domains, new_domains, left, right, g0, g1, v, w, X, partition_scratch);
+        current.push_back(VtxPair(v, w));
+        solve(current, new_domains, X, left, right, depth + 1, path_hash);
+        current.pop_back();
+        bd.right_len++;
+    }
+
+    // Makes the branches of a node available to idle threads, then explores
+    // each branch that no other thread has claimed
+    void share_and_solve(vector<VtxPair> & current, vector<Bidomain> & domains,
+            VertexSet & X, vector<VtxIdx> & left, vector<VtxIdx> & right,
+            unsigned int depth, unsigned long long path_hash, int bd_idx, int v)
+    {
+        auto & shared_nodes = shared.shared_nodes;
+        auto node = std::make_shared<SharedNode>();
+        node->current = current;
+        node->left = left;
+        node->right = right;
+        node->domains = domains;
+        node->X = X;
+        node->bd_idx = bd_idx;
+        node->v = v;
+        const Bidomain &bd = domains[bd_idx];
+        node->ws = vector<int>(right.begin() + bd.r, right.begin() + bd.r + bd.right_len);
+        std::sort(node->ws.begin(), node->ws.end());
+        node->depth = depth;
+        node->path_hash = path_hash;
+        if (output_segment)
+            node->output_branches = add_output_branches(node->ws.size() + 1);
+
+        {
+            std::lock_guard<std::mutex> guard(shared_nodes.mutex);
+            shared_nodes.nodes.push_back(node);
+        }
+        shared_nodes.cv.notify_all();
+
+        unsigned int i;
+        while ((i = node->next_branch++) <= node->ws.size()) {
+            OutputSegment * previous_segment = nullptr;
+            if (!node->output_branches.empty())
+                previous_segment = start_output_segment(node->output_branches[i].get());
+            if (shared.explores_branch(depth, i, node->ws.size() + 1)) {
+                int w = i < node->ws.size() ? node->ws[i] : -1;
+                solve_branch(current, domains, X, left, right, depth,
+                        child_path_hash(path_hash, i), bd_idx, v, w);
+            }
+            if (!node->output_branches.empty())
+                finish_output_segment(previous_segment);
+        }
+
+        std::lock_guard<std::mutex> guard(shared_nodes.mutex);
+        shared_nodes.nodes.remove(node);
+    }
+
+    // Explores branches of shared nodes until no thread has any work left
+    void help_with_shared_nodes()
+    {
+        auto & shared_nodes = shared.shared_nodes;
+        std::unique_lock<std::mutex> guard(shared_nodes.mutex);
+        while (true) {
+            std::shared_ptr<SharedNode> node;
+            unsigned int i = 0;
+            auto it = shared_nodes.nodes.begin();
+            while (it != shared_nodes.nodes.end()) {
+                i = (*it)->next_branch++;
+                if (i <= (*it)->ws.size()) {
+                    node = *it;
+                    break;
+                }
+                it = shared_nodes.nodes.erase(it);
+            }
+
+            if (node) {
+                ++shared_nodes.busy_threads;
+                guard.unlock();
+                if (!node->output_branches.empty())
+                    start_output_segment(node->output_branches[i].get());
+                vector<VtxPair> current = node->current;
+                vector<VtxIdx> left = node->left;
+                vector<VtxIdx> right = node->right;
+                vector<Bidomain> domains = node->domains;
+                VertexSet X = node->X;
+                int w = i < node->ws.size() ? node->ws[i] : -1;
+                if (shared.explores_branch(node->depth, i, node->ws.size() + 1))
+                    solve_branch(current, domains, X, left, right, node->depth,
+                            child_path_hash(node->path_hash, i), node->bd_idx, node->v, w);
+                if (!node->output_branches.empty())
+                    finish_output_segment(nullptr);
+                guard.lock();
+                if (--shared_nodes.busy_threads == 0)
+                    shared_nodes.cv.notify_all();
+            } else if (shared_nodes.busy_threads == 0) {
+                return;
+            } else {
+                shared_nodes.cv.wait(guard);
+            }
+        }
+    }
+
+    /*** Sequential search ***/
+
+    // Visits a search node.  If the node is a leaf, or its branches are
+    // shared with other threads, it is finished here; otherwise v is chosen
+    // and a frame is pushed for the node's branches.
+    void start_node(vector<VtxPair> & current, vector<Bidomain> & domains,
+            VertexSet & X, vector<VtxIdx> & left, vector<VtxIdx> & right,
+            unsigned int depth, unsigned long long path_hash)
+    {
+        if (shared.decided)
+            return;
+
+        if (shared.abort) {
+            if (!shared.stopped)
+                stopped_at(frame_path());
+            return;
+        }
+
+        if (checkpoint_due())
+            shared.visitor.checkpoint(frame_path(), solution_count, nodes);
+
+        if (!shared.in_shard(depth, path_hash))
+            return;
+
+        bool on_resume_path = shared.on_resume_path(depth);
+
+        if (Flags::verbose) show(current, domains, left, right);
+        bool counted = shared.counts_node(depth) && !on_resume_path;
+        if (counted)
+            nodes++;
+
+        if (shared.options.min_size &&
+                below_min_size(domains, current.size(), shared.options.min_size)) {
+            if (on_resume_path)
+                throw std::runtime_error("The checkpoint does not match this search");
+            return;
+        }
+
+        int bd_idx = select_bidomain<Flags>(domains, current.size());
+        if (bd_idx == -1) {
+            if (on_resume_path)
+                throw std::runtime_error("The checkpoint does not match this search");
+            bool is_maximal = true;
+            if (Flags::connected && !current.empty()) {
+                for (auto & bd : domains) {
+                    if (bd.X_count && bd.is_adjacent) {
+                        is_maximal = false;
+                        break;
+                    }
+                }
+            } else if (!domains.empty()) {
+                is_maximal = false;
+            }
+            // A connected solution can be smaller than its node's bound
+            if (is_maximal && counted && current.size() >= shared.options.min_size) {
+                show_current(current);
+            }
+            return;
+        }
+        Bidomain &bd = domains[bd_idx];
+
+        int v = find_and_remove_first_val(bd, left, X);
+
+        if (shared.options.threads > 1 && depth < (unsigned int) shared.options.split_depth) {
+            share_and_solve(current, domains, X, left, right, depth, path_hash, bd_idx, v);
+            return;
+        }
+
+        // v will be assigned to each vertex w in bd's right set, in
+        // increasing order.  The children permute the set, so before each
+        // child it is rewritten from a sorted copy, with w at the end.
+        auto & ws = search_level(depth).ws;
+        VtxIdx *right_vals = right.data() + bd.r;
+        ws.assign(right_vals, right_vals + bd.right_len);
+        std::sort(ws.begin(), ws.end());
+        bd.right_len--;
+        unsigned int first_branch = 0;
+        if (on_resume_path)
+            first_branch = shared.resume_branch(depth, ws.size() + 1);
+        search_frames.push_back({&domains, bd_idx, v, depth, path_hash, first_branch, false});
+    }
+
+    void solve(vector<VtxPair> & current, vector<Bidomain> & domains,
+            VertexSet & X, vector<VtxIdx> & left, vector<VtxIdx> & right,
+            unsigned int depth, unsigned long long path_hash)
+    {
+        // Frames below base belong to a search that has called this one
+        size_t base = search_frames.size();
+        search_frames.reserve(base + g0.n + 1);
+        start_node(current, domains, X, left, right, depth, path_hash);
+        explore_frames(current, X, left, right, base);
+    }
+
+    // Explores the branches of the frames above base until there are none
+    // left, or until a solution is found if pause_at_solutions is set
+    void explore_frames(vector<VtxPair> & current, VertexSet & X,
+            vector<VtxIdx> & left, vector<VtxIdx> & right, size_t base)
+    {
+        while (search_frames.size() > base && !paused) {
+            SearchFrame & frame = search_frames.back();
+            if (frame.in_assignment) {
+                current.pop_back();
+                frame.in_assignment = false;
+            }
+            Bidomain &bd = (*frame.domains)[frame.bd_idx];
+            SearchLevel & level = search_level(frame.depth);
+            unsigned int ws_count = level.ws.size();
+            int branch_count = ws_count + 1;
+            while (frame.next_branch < ws_count &&
+                    !shared.explores_branch(frame.depth, frame.next_branch, branch_count))
+                ++frame.next_branch;
+            unsigned int i = frame.next_branch++;
+            // start_node() may push a frame, after which frame is not to be used
+            unsigned int child_depth = frame.depth + 1;
+            unsigned long long child_hash = child_path_hash(frame.path_hash, i);
+
+            if (i < ws_count) {
+                int w = level.ws[i];
+                VtxIdx *right_vals = right.data() + bd.r;
+                std::copy(level.ws.begin(), level.ws.begin() + i, right_vals);
+                std::copy(level.ws.begin() + i + 1, level.ws.end(), right_vals + i);
+                right_vals[bd.right_len] = w;
+
+                filter_domains(*frame.domains, level.domains, left, right, g0, g1,
+                        frame.v, w, X, partition_scratch);
+                current.push_back(VtxPair(frame.v, w));
+                frame.in_assignment = true;
+                start_node(current, level.domains, X, left, right, child_depth, child_hash);
+            } else if (i == ws_count) {
+                bd.left_len++;
+                bd.right_len++;
+                if (!shared.explores_branch(frame.depth, i, branch_count)) {
+                    search_frames.pop_back();
+                    continue;
+                }
+                X.insert(frame.v);
+                ++bd.X_count;
+                start_node(current, *frame.domains, X, left, right, child_depth, child_hash);
+            } else {
+                X.erase(frame.v);
+                search_frames.pop_back();
+            }
+        }
+    }
+};
+
+/*******************************************************************************
+                         Search of small graphs using masks
+*******************************************************************************/
+
+// If neither graph has more than 128 vertices, each half of a bidomain, X and
+// each row of the adjacency matrix fits in a Mask, which is a uint64_t for up
+// to 64 vertices and an unsigned __int128 otherwise.  Filtering a domain then
+// takes a few ANDs, and no buffers need to be partitioned.  The search tree,
+// and the order in which solutions are found, are the same as for solve().
+
+typedef unsigned __int128 uint128_t;
+
+inline int lowest_vertex(uint64_t mask) {
+    return __builtin_ctzll(mask);
+}
+
+inline int lowest_vertex(uint128_t mask) {
+    uint64_t low = (uint64_t) mask;
+    return low ? __builtin_ctzll(low) : 64 + __builtin_ctzll((uint64_t) (mask >> 64));
+}
+
+inline int vertex_count(uint64_t mask) {
+    return __builtin_popcountll(mask);
+}
+
+inline int vertex_count(uint128_t mask) {
+    return __builtin_popcountll((uint64_t) mask) + __builtin_popcountll((uint64_t) (mask >> 64));
+}
+
+template <typename Mask>
+struct MaskBidomain {
+    Mask left, right;
+    bool is_adjacent;
+};
+
+// Restricted is whether the search is limited to a subtree or a shard.  If
+// it is not, every node is in the search and counted and every branch is
+// taken, so the tests of these are compiled out, and so are the path hashes.
+// Checkpoints is whether checkpoint_due is set or a checkpoint is being
+// resumed; if not, the path is not tracked and checkpoint_due is not polled.
+template <typename Mask, typename Flags, bool Restricted, bool Checkpoints>
+struct MaskSearch {
+    SearchThread<Flags> & thread;
+    SharedSearch & shared;
+    vector<Mask> rows0;
+    vector<Mask> rows1;
+    // The domains of the children of the node at each depth; a node at depth
+    // d uses only one vertex of g0, so there are at most g0.n + 1 depths.  The
+    // left halves of a node's domains are disjoint, so it has at most g0.n.
+    vector<vector<MaskBidomain<Mask>>> levels;
+    vector<VtxPair> current;
+    Mask X = 0;
+    vector<int> path;  // the path of the node being visited, with Checkpoints
+
+    MaskSearch(SearchThread<Flags> & thread) :
+            thread(thread), shared(thread.shared), rows0(thread.g0.n), rows1(thread.g1.n),
+            levels(thread.g0.n + 1, vector<MaskBidomain<Mask>>(2 * thread.g0.n + 2))
+    {
+        for (int v=0; v<thread.g0.n; v++)
+            rows0[v] = row_mask(thread.g0.adjrow(v));
+        for (int w=0; w<thread.g1.n; w++)
+            rows1[w] = row_mask(thread.g1.adjrow(w));
+    }
+
+    // Rows of the adjacency matrix have at least two words
+    static Mask row_mask(const uint64_t *row) {
+        return sizeof(Mask) == 8 ? row[0] : row[0] | (Mask) row[1] << 32 << 32;
+    }
+
+    static Mask bit(int v) { return (Mask) 1 << v; }
+
+    bool in_shard(unsigned int depth, unsigned long long path_hash) const
+    {
+        return !Restricted || shared.in_shard(depth, path_hash);
+    }
+
+    bool counts_node(unsigned int depth) const
+    {
+        return !Restricted || shared.counts_node(depth);
+    }
+
+    bool explores_branch(unsigned int depth, int branch, int branch_count) const
+    {
+        return !Restricted || shared.explores_branch(depth, branch, branch_count);
+    }
+
+    static unsigned long long child_hash(unsigned long long path_hash, int branch)
+    {
+        return Restricted ? child_path_hash(path_hash, branch) : 0;
+    }
+
+    // Writes the domains of the child that assigns v to w to new_d, which
+    // must have room for 2 * count, and returns how many there are.  Both
+    // halves of each old domain are written, and kept only if neither side is
+    // empty, so that there is no branch to mispredict.
+    int filter_domains(const MaskBidomain<Mask> *d, int count,
+            MaskBidomain<Mask> *new_d, int v, int w)
+    {
+        int new_count = 0;
+        Mask row0 = rows0[v];
+        Mask row1 = rows1[w];
+        for (int i=0; i<count; i++) {
+            const auto & old_bd = d[i];
+            Mask left_noedge = old_bd.left & ~row0;
+            Mask right_noedge = old_bd.right & ~row1;
+            new_d[new_count] = {left_noedge, right_noedge, old_bd.is_adjacent};
+            new_count += (left_noedge != 0) & (right_noedge != 0);
+            Mask left_edge = old_bd.left & row0;
+            Mask right_edge = old_bd.right & row1;
+            new_d[new_count] = {left_edge, right_edge, true};
+            new_count += (left_edge != 0) & (right_edge != 0);
+        }
+        return new_count;
+    }
+
+    // As below_min_size(), for mask domains
+    bool below_min_size(const MaskBidomain<Mask> *domains, int count)
+    {
+        unsigned int min_size = shared.options.min_size;
+        unsigned int bound = current.size();
+        for (int i=0; i<count; i++) {
+            const auto & bd = domains[i];
+            if (bound >= min_size)
+                return false;
+            bound += std::min(vertex_count(bd.left & ~X), vertex_count(bd.right));
+        }
+        return bound < min_size;
+    }
+
+    void solve(MaskBidomain<Mask> *domains, int count, unsigned int depth,
+            unsigned long long path_hash)
+    {
+        if (shared.decided)
+            return;
+
+        if (shared.abort) {
+            thread.stopped_at(path);
+            return;
+        }
+
+        if (Checkpoints && thread.checkpoint_due())
+            shared.visitor.checkpoint(path, thread.solution_count, thread.nodes);
+
+        if (!in_shard(depth, path_hash))
+            return;
+
+        bool on_resume_path = Checkpoints && shared.on_resume_path(depth);
+
+        bool counted = counts_node(depth) && !on_resume_path;
+        if (counted)
+            thread.nodes++;
+
+        if (shared.options.min_size && below_min_size(domains, count)) {
+            if (on_resume_path)
+                throw std::runtime_error("The checkpoint does not match this search");
+            return;
+        }
+
+        int bd_idx = -1;
+        for (int i=0; i<count; i++) {
+            if (!(domains[i].left & ~X))
+                continue;
+            if (Flags::connected && !current.empty() && !domains[i].is_adjacent)
+                continue;
+            bd_idx = i;
+            break;
+        }
+        if (bd_idx == -1) {
+            if (on_resume_path)
+                throw std::runtime_error("The checkpoint does not match this search");
+            bool is_maximal = true;
+            if (Flags::connected && !current.empty()) {
+                for (int i=0; i<count; i++) {
+                    if ((domains[i].left & X) && domains[i].is_adjacent) {
+                        is_maximal = false;
+                        break;
+                    }
+                }
+            } else if (count) {
+                is_maximal = false;
+            }
+            if (is_maximal && counted && current.size() >= shared.options.min_size)
+                thread.show_current(current);
+            return;
+        }
+        MaskBidomain<Mask> &bd = domains[bd_idx];
+
+        int v = lowest_vertex(bd.left & ~X);
+        bd.left &= ~bit(v);
+
+        // Try assigning v to each vertex w in bd's right set, in increasing
+        // order
+        MaskBidomain<Mask> *new_domains = levels[depth].data();
+        Mask ws = bd.right;
+        int branch_count = vertex_count(ws) + 1;
+        int first_branch = 0;
+        if (on_resume_path)
+            first_branch = shared.resume_branch(depth, branch_count);
+        int i = 0;
+        for (Mask rest=ws; rest; rest &= rest - 1, i++) {
+            if (i < first_branch || !explores_branch(depth, i, branch_count))
+                continue;
+            int w = lowest_vertex(rest);
+            bd.right = ws & ~bit(w);
+            int new_count = filter_domains(domains, count, new_domains, v, w);
+            current.push_back(VtxPair(v, w));
+            if (Checkpoints)
+                path.push_back(i);
+            solve(new_domains, new_count, depth + 1, child_hash(path_hash, i));
+            if (Checkpoints)
+                path.pop_back();
+            current.pop_back();
+        }
+        bd.left |= bit(v);
+        bd.right = ws;
+        if (!explores_branch(depth, branch_count - 1, branch_count))
+            return;
+        X |= bit(v);
+        if (Checkpoints)
+            path.push_back(-1);
+        solve(domains, count, depth + 1, child_hash(path_hash, branch_count - 1));
+        if (Checkpoints)
+            path.pop_back();
+        X &= ~bit(v);
+    }
+};
+
+template <typename Mask, typename Flags, bool Restricted, bool Checkpoints>
+void run_mask_search(SearchThread<Flags> & thread, const vector<Bidomain> & domains,
+        const vector<VtxIdx> & left, const vector<VtxIdx> & right)
+{
+    MaskSearch<Mask, Flags, Restricted, Checkpoints> search(thread);
+    vector<MaskBidomain<Mask>> mask_domains;
+    for (const Bidomain & bd : domains) {
+        MaskBidomain<Mask> mask_bd {0, 0, bd.is_adjacent};
+        for (int i=0; i<bd.left_len; i++)
+            mask_bd.left |= search.bit(left[bd.l + i]);
+        for (int i=0; i<bd.right_len; i++)
+            mask_bd.right |= search.bit(right[bd.r + i]);
+        mask_domains.push_back(mask_bd);
+    }
+    search.solve(mask_domains.data(), mask_domains.size(), 0, root_path_hash);
+}
+
+// Runs the search from the root using masks; both graphs must have at most
+// as many vertices as a Mask has bits
+template <typename Mask, typename Flags>
+void solve_with_masks(SearchThread<Flags> & thread, const vector<Bidomain> & domains,
+        const vector<VtxIdx> & left, const vector<VtxIdx> & right)
+{
+    const McsplitOptions & options = thread.shared.options;
+    bool restricted = !options.subtree_path.empty() || options.shard_count != 0;
+    bool checkpoints = options.checkpoint_due || !options.resume_path.empty();
+    if (!restricted && !checkpoints)
+        run_mask_search<Mask, Flags, false, false>(thread, domains, left, right);
+    else if (!restricted)
+        run_mask_search<Mask, Flags, false, true>(thread, domains, left, right);
+    else if (!checkpoints)
+        run_mask_search<Mask, Flags, true, false>(thread, domains, left, right);
+    else
+        run_mask_search<Mask, Flags, true, true>(thread, domains, left, right);
+}
+
+// Searches from the root, whose domains have been set up in the buffers
+// left and right
+template <typename Flags>
+void search(SharedSearch & shared, vector<Bidomain> & domains,
+        vector<VtxIdx> & left, vector<VtxIdx> & right)
+{
+    const Graph & g0 = shared.g0;
+    const Graph & g1 = shared.g1;
+    vector<VtxPair> current;
+    VertexSet X(g0.n);
+    SearchThread<Flags> main_thread(shared);
+    main_thread.nodes = shared.options.resume_nodes;
+    main_thread.solution_count = shared.options.resume_solutions;
+
+    if (shared.options.threads == 1) {
+        // The verbose trace shows the buffers, which only solve() has
+        if (!Flags::verbose && g0.n <= 64 && g1.n <= 64)
+            solve_with_masks<uint64_t>(main_thread, domains, left, right);
+        else if (!Flags::verbose && g0.n <= 128 && g1.n <= 128)
+            solve_with_masks<uint128_t>(main_thread, domains, left, right);
+        else
+            main_thread.solve(current, domains, X, left, right, 0, root_path_hash);
+        shared.add_thread_stats_to_totals(main_thread.nodes, main_thread.solution_count);
+        return;
+    }
+
+    // The main thread explores the search tree from its root, and the helper
+    // threads take branches of shared nodes as they appear
+    auto & shared_nodes = shared.shared_nodes;
+    shared_nodes.busy_threads = 1;
+    vector<std::thread> helpers;
+    for (int i=1; i<shared.options.threads; i++) {
+        helpers.emplace_back([&] {
+                SearchThread<Flags> helper(shared);
+                helper.help_with_shared_nodes();
+                shared.add_thread_stats_to_totals(helper.nodes, helper.solution_count);
+                });
+    }
+    std::thread sequencer;
+    if (shared.options.ordered && !Flags::quiet) {
+        auto root_segment = std::make_shared<OutputSegment>();
+        sequencer = std::thread(&SharedSearch::run_sequencer, &shared, root_segment);
+        main_thread.start_output_segment(root_segment.get());
+    }
+    main_thread.solve(current, domains, X, left, right, 0, root_path_hash);
+    if (main_thread.output_segment)
+        main_thread.finish_output_segment(nullptr);
+    {
+        std::lock_guard<std::mutex> guard(shared_nodes.mutex);
+        if (--shared_nodes.busy_threads == 0)
+            shared_nodes.cv.notify_all();
+    }
+    main_thread.help_with_shared_nodes();
+    for (auto & helper : helpers)
+        helper.join();
+    if (sequencer.joinable())
+        sequencer.join();
+    shared.add_thread_stats_to_totals(main_thread.nodes, main_thread.solution_count);
+}
+
+// Fills the buffers left and right for the root of the search, and returns
+// its domains
+static vector<Bidomain> root_domains(const Graph & g0, const Graph & g1,
+        vector<VtxIdx> & left, vector<VtxIdx> & right)
+{
+    left.reserve(g0.n);
+    right.reserve(g1.n);
+
+    auto domains = vector<Bidomain> {};
+
+    std::set<unsigned int> left_labels;
+    std::set<unsigned int> right_labels;
+    for (unsigned int label : g0.label) left_labels.insert(label);
+    for (unsigned int label : g1.label) right_labels.insert(label);
+    std::set<unsigned int> labels;  // labels that appear in both graphs
+    std::set_intersection(std::begin(left_labels),
+                          std::end(left_labels),
+                          std::begin(right_labels),
+                          std::end(right_labels),
+                          std::inserter(labels, std::begin(labels)));
+
+    // Create a bidomain for each label that appears in both graphs
+    for (unsigned int label : labels) {
+        int start_l = left.size();
+        int start_r = right.size();
+
+        for (int i=0; i<g0.n; i++)
+            if (g0.label[i]==label)
+                left.push_back(i);
+        for (int i=0; i<g1.n; i++)
+            if (g1.label[i]==label)
+                right.push_back(i);
+
+        domains.push_back({start_l, start_r, (int) left.size() - start_l,
+                (int) right.size() - start_r, false, 0});
+    }
+    return domains;
+}
+
+static void check_graph_sizes(const Graph & g0, const Graph & g1)
+{
+    if ((unsigned long) g0.n > std::numeric_limits<VtxIdx>::max() ||
+            (unsigned long) g1.n > std::numeric_limits<VtxIdx>::max())
+        throw std::invalid_argument("Too many vertices for this build; rebuild without SMALL_VERTEX_IDS");
+}
+
+McsplitResult mcsplit(const Graph & g0, const Graph & g1,
+        const McsplitOptions & options, McsplitVisitor & visitor)
+{
+    check_graph_sizes(g0, g1);
+    if (options.threads < 1)
+        throw std::invalid_argument("The number of threads must be at least 1");
+    if ((options.checkpoint_due || !options.resume_path.empty() || options.resume_nodes)
+            && options.threads > 1)
+        throw std::invalid_argument("Checkpoints need a single search thread");
+
+    vector<VtxIdx> left;  // the buffer of vertex indices for the left partitions
+    vector<VtxIdx> right;  // the buffer of vertex indices for the right partitions
+    auto domains = root_domains(g0, g1, left, right);
+
+    static const std::atomic<bool> never_abort{ false };
+    SharedSearch shared(g0, g1, options, visitor, options.abort ? *options.abort : never_abort);
+
+    switch (4 * options.connected + 2 * options.verbose + options.quiet) {
+        case 0: search<SearchFlags<false, false, false>>(shared, domains, left, right); break;
+        case 1: search<SearchFlags<false, false, true>>(shared, domains, left, right); break;
+        case 2: search<SearchFlags<false, true, false>>(shared, domains, left, right); break;
+        case 3: search<SearchFlags<false, true, true>>(shared, domains, left, right); break;
+        case 4: search<SearchFlags<true, false, false>>(shared, domains, left, right); break;
+        case 5: search<SearchFlags<true, false, true>>(shared, domains, left, right); break;
+        case 6: search<SearchFlags<true, true, false>>(shared, domains, left, right); break;
+        case 7: search<SearchFlags<true, true, true>>(shared, domains, left, right); break;
+    }
+
+    return {shared.total_solution_count, shared.total_nodes, shared.stopped};
+}
+
+struct FunctionVisitor : McsplitVisitor {
+    std::function<void(const vector<VtxPair> &)> visit_solution;
+    void solution(const vector<VtxPair> & solution) { visit_solution(solution); }
+};
+
+McsplitResult mcsplit(const Graph & g0, const Graph & g1, const McsplitOptions & options,
+        std::function<void(const vector<VtxPair> &)> visit_solution)
+{
+    FunctionVisitor visitor;
+    visitor.visit_solution = visit_solution;
+    return mcsplit(g0, g1, options, visitor);
+}
+
+/*******************************************************************************
+                                   Generator
+*******************************************************************************/
+
+// The search of a generator runs on the frame stack of a single SearchThread,
+// which stops after each solution.  next() picks up where it stopped.
+
+struct McsplitGenerator::State {
+    virtual ~State() {}
+    virtual bool next(vector<VtxPair> & solution) = 0;
+    virtual unsigned long long solutions() const = 0;
+    virtual unsigned long long nodes() const = 0;
+};
+
+// Copies each solution to where next() asked for it
+struct GeneratorVisitor : McsplitVisitor {
+    vector<VtxPair> * solution_out = nullptr;
+    void solution(const vector<VtxPair> & solution) { *solution_out = solution; }
+};
+
+template <typename Flags>
+struct GeneratorState : McsplitGenerator::State {
+    McsplitOptions options;
+    GeneratorVisitor visitor;
+    SharedSearch shared;
+    SearchThread<Flags> thread;
+    vector<VtxIdx> left;
+    vector<VtxIdx> right;
+    vector<Bidomain> domains;
+    VertexSet X;
+    vector<VtxPair> current;
+    bool started = false;
+
+    GeneratorState(const Graph & g0, const Graph & g1, const McsplitOptions & options,
+            const std::atomic<bool> & abort) :
+            options(options), shared(g0, g1, this->options, visitor, abort),
+            thread(shared), X(g0.n)
+    {
+        domains = root_domains(g0, g1, left, right);
+        thread.nodes = options.resume_nodes;
+        thread.solution_count = options.resume_solutions;
+        thread.pause_at_solutions = true;
+    }
+
+    bool next(vector<VtxPair> & solution)
+    {
+        visitor.solution_out = &solution;
+        thread.paused = false;
+        if (!started) {
+            started = true;
+            thread.search_frames.reserve(shared.g0.n + 1);
+            thread.start_node(current, domains, X, left, right, 0, root_path_hash);
+        }
+        thread.explore_frames(current, X, left, right, 0);
+        return thread.paused;
+    }
+
+    unsigned long long solutions() const { return thread.solution_count; }
+    unsigned long long nodes() const { return thread.nodes; }
+};
+
+McsplitGenerator::McsplitGenerator(const Graph & g0, const Graph & g1,
+        const McsplitOptions & options)
+{
+    check_graph_sizes(g0, g1);
+    if (options.threads != 1 || options.verbose || options.quiet)
+        throw std::invalid_argument("A generator needs a single search thread, "
+                "and cannot be verbose or quiet");
+    static const std::atomic<bool> never_abort{ false };
+    const std::atomic<bool> & abort = options.abort ? *options.abort : never_abort;
+    if (options.connected)
+        state.reset(new GeneratorState<SearchFlags<true, false, false>>(g0, g1, options, abort));
+    else
+        state.reset(new GeneratorState<SearchFlags<false, false, false>>(g0, g1, options, abort));
+}
+
+McsplitGenerator::~McsplitGenerator()
+{
+}
+
+bool McsplitGenerator::next(vector<VtxPair> & solution)
+{
+    return state->next(solution);
+}
+
+unsigned long long McsplitGenerator::solutions() const
+{
+    return state->solutions();
+}
+
+unsigned long long McsplitGenerator::nodes() const
+{
+    return state->nodes();
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "graph.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// libmcsplit finds the maximal common induced subgraphs of two graphs, and
+// passes each one to a visitor.  All the state of a search belongs to its call
+// of mcsplit(), so any number of searches may run at once, on any threads.
+//
+// A Graph can be read from a file with readGraph(), which throws
+// std::runtime_error if the file cannot be read, or built in memory: create
+// Graph(n), set label[v] for each vertex, then call add_edge() for each edge.
+// See mcsplit_example.c.
+
+struct VtxPair {
+    int v;
+    int w;
+    VtxPair(int v, int w): v(v), w(w) {}
+};
+
+struct McsplitOptions {
+    // Only find connected common subgraphs
+    bool connected = false;
+    // Call the visitor's node() at every search node
+    bool verbose = false;
+    // Count the solutions without passing them to the visitor
+    bool quiet = false;
+
+    // Only find solutions of at least min_size pairs.  A node is pruned if the
+    // pairs it has, plus the most that its bidomains could add, are too few.
+    unsigned int min_size = 0;
+    // Stop at the first solution found, so that the search only decides
+    // whether there is one
+    bool stop_at_first = false;
+
+    // The number of threads searching, and the depth above which idle threads
+    // may take branches of nodes.  With ordered, the visitor is given the
+    // solutions in the same order as a single thread would find them.
+    int threads = 1;
+    int split_depth = 4;
+    bool ordered = false;
+
+    // Only explore the subtree at the end of this path of branch numbers from
+    // the root; branch i assigns the current vertex to the i-th smallest
+    // candidate, and -1 stands for the last branch, which adds it to X
+    std::vector<int> subtree_path;
+
+    // If shard_count is not 0, only explore shard shard_index of shard_count;
+    // the shards divide the nodes split_depth below the subtree between them
+    int shard_index = 0;
+    int shard_count = 0;
+
+    // If not null, the search stops soon after this becomes true
+    const std::atomic<bool> * abort = nullptr;
+
+    // If not null, the search takes a checkpoint soon after this becomes
+    // true, and sets it back to false, and another if it is stopped.  A
+    // search without it does not keep track of where it is.
+    std::atomic<bool> * checkpoint_due = nullptr;
+
+    // Continue the search from a checkpoint, which was taken at the node at
+    // the end of this path after counting these solutions and nodes
+    std::vector<int> resume_path;
+    unsigned long long resume_solutions = 0;
+    unsigned long long resume_nodes = 0;
+};
+
+// Receives the results of a search.  Its functions are never called by two
+// threads at once.
+class McsplitVisitor {
+public:
+    virtual ~McsplitVisitor() {}
+
+    // Called for each maximal common subgraph, unless the search is quiet
+    virtual void solution(const std::vector<VtxPair> & solution) = 0;
+
+    // With verbose, called at each search node with the number of nodes
+    // counted so far, the current assignment, and the vertices of each
+    // bidomain
+    virtual void node(unsigned long long nodes, const std::vector<VtxPair> & current,
+            const std::vector<std::vector<int>> & left_sets,
+            const std::vector<std::vector<int>> & right_sets) {}
+
+    // Called when a search with checkpoint_due is stopped, and whenever
+    // checkpoint_due becomes true, with the path of the node at which the
+    // search would continue and the numbers of solutions and nodes counted
+    // before it.  Passing these back as resume_path, resume_solutions and
+    // resume_nodes continues the search from there.
+    virtual void checkpoint(const std::vector<int> & path,
+            unsigned long long solutions, unsigned long long nodes) {}
+};
+
+struct McsplitResult {
+    unsigned long long solutions;
+    unsigned long long nodes;
+    // Whether the search was stopped by abort before it finished
+    bool stopped;
+};
+
+// Searches g0 and g1.  Throws std::invalid_argument if the options cannot be
+// used together or the graphs are too large for this build, and
+// std::runtime_error if resume_path is not a node of this search.
+McsplitResult mcsplit(const Graph & g0, const Graph & g1,
+        const McsplitOptions & options, McsplitVisitor & visitor);
+
+// As above, calling visit_solution for each maximal common subgraph
+McsplitResult mcsplit(const Graph & g0, const Graph & g1, const McsplitOptions & options,
+        std::function<void(const std::vector<VtxPair> &)> visit_solution);
+
+// Finds the maximal common subgraphs of two graphs one at a time, as they are
+// asked for.  The search runs only inside next(), and stops as soon as it
+// finds a solution, so no work is done beyond the last solution asked for.
+// Solutions come in the same order as from a single-threaded mcsplit().
+// The graphs must outlive the generator.  Only a single search thread is
+// supported, and verbose and quiet cannot be set.  The other options apply as
+// they do to mcsplit(), except for checkpoint_due.
+class McsplitGenerator {
+public:
+    McsplitGenerator(const Graph & g0, const Graph & g1,
+            const McsplitOptions & options = McsplitOptions());
+    ~McsplitGenerator();
+
+    // Sets solution to the next maximal common subgraph and returns true, or
+    // returns false if there are no more
+    bool next(std::vector<VtxPair> & solution);
+
+    // The numbers of solutions and search nodes so far
+    unsigned long long solutions() const;
+    unsigned long long nodes() const;
+
+    struct State;
+
+private:
+    std::unique_ptr<State> state;
+};
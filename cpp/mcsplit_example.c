@@ -0,0 +1,98 @@
+// An example of using libmcsplit.  Searches the two graphs named on the
+// command line in each of the ways that mcsplit.h offers, checks that they
+// agree, and prints the counts as `mcsp --quiet` would; `make check` compares
+// the two.
+
+#include "graph.h"
+#include "mcsplit.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+
+using std::vector;
+using std::cout;
+using std::endl;
+
+static void fail(std::string msg) {
+    std::cerr << msg << std::endl;
+    exit(1);
+}
+
+static void expect_equal(unsigned long long got, unsigned long long expected, const char *what) {
+    if (got != expected)
+        fail(std::string(what) + ": " + std::to_string(got) + " rather than " +
+                std::to_string(expected));
+}
+
+// Counts the solutions it is given
+struct CountingVisitor : McsplitVisitor {
+    unsigned long long solutions = 0;
+    void solution(const vector<VtxPair> &) { ++solutions; }
+};
+
+// Returns a copy of g built in memory, edge by edge
+static Graph copy_graph(const Graph & g) {
+    Graph copy(g.n);
+    for (int v=0; v<g.n; v++)
+        copy.label[v] = g.label[v];
+    for (int v=0; v<g.n; v++)
+        for (int w=v+1; w<g.n; w++)
+            if (g.adjacent(v, w))
+                add_edge(copy, v, w);
+    return copy;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3)
+        fail("Usage: mcsplit_example FILENAME1 FILENAME2");
+
+    try {
+        Graph g0 = readGraph(argv[1]);
+        Graph g1 = readGraph(argv[2]);
+
+        // A search with a visitor
+        CountingVisitor visitor;
+        McsplitResult result = mcsplit(g0, g1, McsplitOptions(), visitor);
+        expect_equal(visitor.solutions, result.solutions, "Solutions given to the visitor");
+
+        // Two searches at once: one of copies built with add_edge(), and one
+        // on two threads of its own, each passing its solutions to a function
+        Graph copy0 = copy_graph(g0);
+        Graph copy1 = copy_graph(g1);
+        unsigned long long copy_count = 0;
+        McsplitResult copy_result;
+        std::thread copy_thread([&] {
+                copy_result = mcsplit(copy0, copy1, McsplitOptions(),
+                        [&](const vector<VtxPair> &) { ++copy_count; });
+                });
+        McsplitOptions threaded_options;
+        threaded_options.threads = 2;
+        unsigned long long threaded_count = 0;
+        McsplitResult threaded_result = mcsplit(g0, g1, threaded_options,
+                [&](const vector<VtxPair> &) { ++threaded_count; });
+        copy_thread.join();
+        expect_equal(copy_count, result.solutions, "Solutions of the copies");
+        expect_equal(copy_result.nodes, result.nodes, "Nodes of the copies");
+        expect_equal(threaded_count, result.solutions, "Solutions on two threads");
+        expect_equal(threaded_result.solutions, result.solutions, "Solutions counted on two threads");
+
+        // The solutions pulled one at a time
+        McsplitGenerator generator(g0, g1);
+        vector<VtxPair> solution;
+        unsigned long long pulled = 0;
+        while (generator.next(solution))
+            ++pulled;
+        expect_equal(pulled, result.solutions, "Solutions pulled from a generator");
+        expect_equal(generator.nodes(), result.nodes, "Nodes of a generator");
+
+        cout << "Solutions:                  " << result.solutions << endl;
+        cout << "Nodes:                      " << result.nodes << endl;
+    } catch (const std::exception & e) {
+        fail(e.what());
+    }
+}
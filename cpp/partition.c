@@ -0,0 +1,178 @@
+#include "partition.h"
+
+#include <string.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+static inline int bit(const uint64_t *bits, int v) {
+    return (bits[v >> 6] >> (v & 63)) & 1;
+}
+
+// Partitions arr[i..len), adding the vertices in row to arr[t..] and the rest
+// to scratch[f..].  Since t <= i, nothing is overwritten before it is read.
+template <bool count_X>
+static inline void partition_from(int *arr, int i, int len, const uint64_t *row,
+        const uint64_t *X, int & t, int & f, int & x, int *scratch)
+{
+    for ( ; i<len; i++) {
+        int v = arr[i];
+        int in_row = bit(row, v);
+        arr[t] = v;
+        scratch[f] = v;
+        t += in_row;
+        f += 1 - in_row;
+        if (count_X)
+            x += in_row & bit(X, v);
+    }
+}
+
+static inline void partition_from(int *arr, int i, int len, const uint64_t *row,
+        const uint64_t *X, int & t, int & f, int & x, int *scratch)
+{
+    if (X)
+        partition_from<true>(arr, i, len, row, X, t, f, x, scratch);
+    else
+        partition_from<false>(arr, i, len, row, X, t, f, x, scratch);
+}
+
+// Moves the vertices from scratch to the back of arr, and returns the
+// number at the front
+static inline int finish_partition(int *arr, int t, int f, int x,
+        const uint64_t *X, int *X_count, int *scratch)
+{
+    memcpy(arr + t, scratch, f * sizeof(int));
+    if (X)
+        *X_count = x;
+    return t;
+}
+
+int partition_scalar(int *arr, int len, const uint64_t *row,
+        const uint64_t *X, int *X_count, int *scratch)
+{
+    int t = 0, f = 0, x = 0;
+    partition_from(arr, 0, len, row, X, t, f, x, scratch);
+    return finish_partition(arr, t, f, x, X, X_count, scratch);
+}
+
+#ifdef __x86_64__
+
+// For each 8-bit mask, the indices of the lanes whose bits are set, followed
+// by zeros; permuting by these packs the selected lanes to the front
+static struct PackTable {
+    uint8_t lanes[256][8];
+    PackTable() {
+        for (int mask=0; mask<256; mask++) {
+            int k = 0;
+            for (int lane=0; lane<8; lane++)
+                if (mask & (1 << lane))
+                    lanes[mask][k++] = lane;
+            while (k < 8)
+                lanes[mask][k++] = 0;
+        }
+    }
+} pack_table;
+
+// The bits of a bitset for eight vertices, as the low bits of each lane
+__attribute__((target("avx2")))
+static inline __m256i gather_bits_avx2(const uint64_t *bits, __m256i word_idx, __m256i shift)
+{
+    __m256i words = _mm256_i32gather_epi32((const int *) bits, word_idx, 4);
+    return _mm256_srlv_epi32(words, shift);
+}
+
+__attribute__((target("avx2")))
+static inline int lane_mask_avx2(__m256i bits)
+{
+    return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(bits, 31)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i pack_avx2(__m256i v, int mask)
+{
+    __m128i lanes = _mm_loadl_epi64((const __m128i *) pack_table.lanes[mask]);
+    return _mm256_permutevar8x32_epi32(v, _mm256_cvtepu8_epi32(lanes));
+}
+
+__attribute__((target("avx2")))
+int partition_avx2(int *arr, int len, const uint64_t *row,
+        const uint64_t *X, int *X_count, int *scratch)
+{
+    const __m256i low_bits = _mm256_set1_epi32(31);
+    int t = 0, f = 0, x = 0;
+    int i = 0;
+    for ( ; i+8<=len; i+=8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (arr + i));
+        __m256i word_idx = _mm256_srli_epi32(v, 5);
+        __m256i shift = _mm256_and_si256(v, low_bits);
+        int mask = lane_mask_avx2(gather_bits_avx2(row, word_idx, shift));
+        if (X)
+            x += __builtin_popcount(mask & lane_mask_avx2(gather_bits_avx2(X, word_idx, shift)));
+        // Each store writes eight lanes, but ends no later than arr + i + 8
+        // or scratch + i + 8
+        _mm256_storeu_si256((__m256i *) (arr + t), pack_avx2(v, mask));
+        _mm256_storeu_si256((__m256i *) (scratch + f), pack_avx2(v, ~mask & 255));
+        int count = __builtin_popcount(mask);
+        t += count;
+        f += 8 - count;
+    }
+    partition_from(arr, i, len, row, X, t, f, x, scratch);
+    return finish_partition(arr, t, f, x, X, X_count, scratch);
+}
+
+// GCC 12 warns about the undefined vectors in its AVX-512 intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx512f")))
+int partition_avx512(int *arr, int len, const uint64_t *row,
+        const uint64_t *X, int *X_count, int *scratch)
+{
+    const __m512i low_bits = _mm512_set1_epi32(31);
+    const __m512i one = _mm512_set1_epi32(1);
+    int t = 0, f = 0, x = 0;
+    int i = 0;
+    for ( ; i+16<=len; i+=16) {
+        __m512i v = _mm512_loadu_si512(arr + i);
+        __m512i word_idx = _mm512_srli_epi32(v, 5);
+        __m512i shift = _mm512_and_si512(v, low_bits);
+        __m512i words = _mm512_i32gather_epi32(word_idx, row, 4);
+        __mmask16 mask = _mm512_test_epi32_mask(_mm512_srlv_epi32(words, shift), one);
+        if (X) {
+            __m512i X_words = _mm512_i32gather_epi32(word_idx, X, 4);
+            x += __builtin_popcount(_mm512_mask_test_epi32_mask(mask,
+                        _mm512_srlv_epi32(X_words, shift), one));
+        }
+        // Each store writes sixteen lanes, but ends no later than arr + i + 16
+        // or scratch + i + 16
+        _mm512_storeu_si512(arr + t, _mm512_maskz_compress_epi32(mask, v));
+        _mm512_storeu_si512(scratch + f, _mm512_maskz_compress_epi32(~mask, v));
+        int count = __builtin_popcount(mask);
+        t += count;
+        f += 16 - count;
+    }
+    partition_from(arr, i, len, row, X, t, f, x, scratch);
+    return finish_partition(arr, t, f, x, X, X_count, scratch);
+}
+
+#pragma GCC diagnostic pop
+
+PartitionKernel best_partition_kernel()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return partition_avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return partition_avx2;
+    return nullptr;
+}
+
+#else
+
+PartitionKernel best_partition_kernel()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+// A partition kernel moves the vertices in arr[0..len) whose bits are set in
+// the bitset row to the front of arr, and returns how many there are.  The
+// order of the vertices afterwards is unspecified.  If X is not null,
+// *X_count is set to the number of vertices moved to the front whose bits
+// are set in the bitset X.  scratch must have room for len vertices.
+typedef int (*PartitionKernel)(int *arr, int len, const uint64_t *row,
+        const uint64_t *X, int *X_count, int *scratch);
+
+// The loop that the SIMD kernels finish with.  It is slower than
+// std::partition, so it is only a baseline for partition_bench.
+int partition_scalar(int *arr, int len, const uint64_t *row,
+        const uint64_t *X, int *X_count, int *scratch);
+
+// These may only be called if the CPU supports AVX2 or AVX-512F respectively
+int partition_avx2(int *arr, int len, const uint64_t *row,
+        const uint64_t *X, int *X_count, int *scratch);
+int partition_avx512(int *arr, int len, const uint64_t *row,
+        const uint64_t *X, int *X_count, int *scratch);
+
+// Returns the fastest SIMD kernel that the CPU supports, or null if it has
+// none
+PartitionKernel best_partition_kernel();
@@ -0,0 +1,144 @@
+// Times the partition kernels used by filter_domains() in mcsp on random
+// domains and adjacency rows, and checks that they agree.
+//
+// Usage: partition_bench [n]
+// where n is the number of vertices in the graph (default 4096)
+
+#include "partition.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+using std::vector;
+
+struct Kernel {
+    std::string name;
+    PartitionKernel kernel;
+};
+
+int partition_std(int *arr, int len, const uint64_t *row,
+        const uint64_t *X, int *X_count, int *)
+{
+    int *mid = std::partition(arr, arr + len,
+            [&](const int v){ return (row[v >> 6] >> (v & 63)) & 1; });
+    if (X) {
+        *X_count = 0;
+        for (int *p=arr; p!=mid; p++)
+            *X_count += (X[*p >> 6] >> (*p & 63)) & 1;
+    }
+    return mid - arr;
+}
+
+// A random bitset of n bits, each set with probability p
+vector<uint64_t> random_bitset(int n, double p, std::mt19937 & rng)
+{
+    std::bernoulli_distribution coin(p);
+    vector<uint64_t> bits((n + 63) / 64, 0);
+    for (int v=0; v<n; v++)
+        if (coin(rng))
+            bits[v >> 6] |= uint64_t(1) << (v & 63);
+    return bits;
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 4096;
+    std::mt19937 rng(1);
+
+    vector<Kernel> kernels { {"std::partition", partition_std}, {"scalar", partition_scalar} };
+#ifdef __x86_64__
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        kernels.push_back({"avx2", partition_avx2});
+    if (__builtin_cpu_supports("avx512f"))
+        kernels.push_back({"avx512", partition_avx512});
+#endif
+
+    std::cout << "n = " << n << "; ns per vertex, with X counted in the same pass" << std::endl;
+    std::cout << std::setw(8) << "len" << std::setw(8) << "density";
+    for (auto & k : kernels)
+        std::cout << std::setw(16) << k.name;
+    std::cout << std::setw(10) << "speedup" << std::endl;
+
+    for (double density : {0.1, 0.5}) {
+        for (int len : {16, 64, 256, 1024, std::min(n, 4096)}) {
+            if (len > n)
+                continue;
+            // Enough domains that each size does a similar amount of work
+            const int domain_count = 64;
+            const int reps = std::max(1, (1 << 22) / (len * domain_count));
+            vector<vector<uint64_t>> rows;
+            vector<vector<int>> domains;
+            vector<int> all(n);
+            std::iota(all.begin(), all.end(), 0);
+            for (int d=0; d<domain_count; d++) {
+                rows.push_back(random_bitset(n, density, rng));
+                std::shuffle(all.begin(), all.end(), rng);
+                domains.push_back(vector<int>(all.begin(), all.begin() + len));
+            }
+            vector<uint64_t> X = random_bitset(n, 0.2, rng);
+            vector<int> arr(len);
+            vector<int> scratch(len);
+
+            // The results of the first kernel, to check the others against
+            vector<vector<int>> expected_fronts;
+            vector<int> expected_X_counts;
+
+            std::cout << std::setw(8) << len << std::setw(8) << std::fixed
+                      << std::setprecision(2) << density;
+            vector<double> times;
+            for (auto & k : kernels) {
+                for (int d=0; d<domain_count; d++) {
+                    arr = domains[d];
+                    int X_count;
+                    int count = k.kernel(arr.data(), len, rows[d].data(), X.data(),
+                            &X_count, scratch.data());
+                    vector<int> front(arr.begin(), arr.begin() + count);
+                    vector<int> sorted = arr;
+                    std::sort(front.begin(), front.end());
+                    std::sort(sorted.begin(), sorted.end());
+                    vector<int> original = domains[d];
+                    std::sort(original.begin(), original.end());
+                    if (sorted != original) {
+                        std::cerr << k.name << " lost vertices" << std::endl;
+                        return 1;
+                    }
+                    if (expected_fronts.size() < (unsigned int) domain_count) {
+                        expected_fronts.push_back(front);
+                        expected_X_counts.push_back(X_count);
+                    } else if (front != expected_fronts[d] || X_count != expected_X_counts[d]) {
+                        std::cerr << k.name << " disagrees with " << kernels[0].name << std::endl;
+                        return 1;
+                    }
+                }
+
+                int checksum = 0;
+                auto start = std::chrono::steady_clock::now();
+                for (int rep=0; rep<reps; rep++) {
+                    for (int d=0; d<domain_count; d++) {
+                        std::copy(domains[d].begin(), domains[d].end(), arr.begin());
+                        int X_count;
+                        checksum += k.kernel(arr.data(), len, rows[d].data(), X.data(),
+                                &X_count, scratch.data());
+                        checksum += X_count;
+                    }
+                }
+                auto stop = std::chrono::steady_clock::now();
+                double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+                times.push_back(ns / ((double) reps * domain_count * len));
+                std::cout << std::setw(16) << times.back();
+                if (checksum == -1)
+                    std::cout << "";  // keeps the calls from being optimised away
+            }
+            double best = *std::min_element(times.begin(), times.end());
+            std::cout << std::setw(9) << times[0] / best << "x" << std::endl;
+        }
+    }
+}
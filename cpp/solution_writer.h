@@ -0,0 +1,102 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Collects lines of output in a large buffer and writes them to stdout a
+// buffer at a time, rather than flushing after every solution.  The writes
+// go through stdio, so output written with cout after a flush() stays in
+// order.  If stdout is a terminal, each line is written as soon as it ends.
+//
+// With start_thread(), full buffers are written by a separate thread while
+// the caller fills the other buffer.
+//
+// With start_binary(), each solution is written as the difference from the
+// previous one, in the binary format described in solution_writer.c, rather
+// than as a line of text.  utils/decode_solutions turns this back into text.
+//
+// A SolutionWriter is not itself thread-safe; callers that share one must
+// hold a lock from the start of each line to its end.
+class SolutionWriter {
+public:
+    SolutionWriter();
+    ~SolutionWriter();
+
+    void start_thread();
+
+    // Starts a binary stream; see solution_writer.c
+    void start_binary();
+
+    // Appends "  (v w)", or in a binary stream adds (v, w) to the solution
+    void put_pair(unsigned int v, unsigned int w) {
+        if (binary)
+            solution.push_back({v, w});
+        else
+            append_pair(buf, v, w);
+    }
+
+    // Ends a line, or in a binary stream a solution, and writes out the
+    // buffer if it is full
+    void end_line() {
+        if (binary)
+            encode_solution();
+        else
+            buf += '\n';
+        end_lines();
+    }
+
+    // Appends lines that already end in newlines
+    void put_lines(const std::string & s) {
+        buf.append(s);
+        end_lines();
+    }
+
+    // Writes out everything put so far, and waits until it has been written
+    void flush();
+
+    // Ends a binary stream, so that text can follow it, and flushes
+    void finish();
+
+    // Writes the decimal digits of n to the start of digits, which must have
+    // room for 10, and returns how many there are
+    static size_t format_unsigned(unsigned int n, char *digits);
+
+    // Appends "  (v w)" to s
+    static void append_pair(std::string & s, unsigned int v, unsigned int w);
+
+private:
+    static const size_t capacity = 1 << 20;
+
+    std::string buf;
+    bool line_buffered;
+
+    // In a binary stream, the solution being put and the previous solution
+    bool binary;
+    std::vector<std::pair<unsigned int, unsigned int>> solution;
+    std::vector<std::pair<unsigned int, unsigned int>> previous_solution;
+
+    // The buffer handed to the writer thread, and whether it is being written
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::string full_buf;
+    bool writing;
+    bool stopping;
+
+    void end_lines() {
+        if (buf.size() >= capacity || line_buffered)
+            write_buffer();
+    }
+
+    void put_varint(unsigned int n);
+    void encode_solution();
+    void write_buffer();
+    void run_thread();
+};
+
+// The writer for solutions on stdout
+extern SolutionWriter solution_writer;
@@ -0,0 +1,106 @@
+// Turns the output of an mcsp run with --binary back into the text that the
+// run would have printed without it.  With --min-size or --max-size, only the
+// solutions with that many pairs or more (or fewer) are printed; the counts
+// at the end are left as they are.  The outputs of several runs, such as
+// those of a search that was resumed from checkpoints, can be concatenated.
+//
+// See cpp/solution_writer.c for the format.
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+const char binary_stream_magic[] = "\x89MCS";
+
+auto read_varint(std::FILE * infile) -> unsigned
+{
+    unsigned n = 0;
+    for (int shift = 0 ; shift < 35 ; shift += 7) {
+        int c = std::getc(infile);
+        if (c == EOF)
+            throw std::string{ "the binary stream ends in the middle of a solution" };
+        n |= unsigned(c & 127) << shift;
+        if (! (c & 128))
+            return n;
+    }
+    throw std::string{ "bad number in the binary stream" };
+}
+
+auto decode_stream(std::FILE * infile, unsigned min_size, unsigned max_size) -> void
+{
+    std::vector<std::pair<unsigned, unsigned>> solution;
+    std::string line;
+    while (true) {
+        unsigned pop = read_varint(infile);
+        if (pop == 0)
+            return;
+        if (pop - 1 > solution.size())
+            throw std::string{ "bad solution in the binary stream" };
+        solution.resize(solution.size() - (pop - 1));
+        unsigned push = read_varint(infile);
+        for (unsigned i = 0 ; i < push ; ++i) {
+            unsigned v = read_varint(infile);
+            unsigned w = read_varint(infile);
+            solution.push_back({ v, w });
+        }
+
+        if (solution.size() < min_size || solution.size() > max_size)
+            continue;
+        line.clear();
+        for (auto & p : solution)
+            line += "  (" + std::to_string(p.first) + " " + std::to_string(p.second) + ")";
+        line += '\n';
+        std::fwrite(line.data(), 1, line.size(), stdout);
+    }
+}
+
+auto decode(std::FILE * infile, unsigned min_size, unsigned max_size) -> void
+{
+    bool at_line_start = true;
+    int c;
+    while ((c = std::getc(infile)) != EOF) {
+        if (at_line_start && char(c) == binary_stream_magic[0]) {
+            char rest[3];
+            if (std::fread(rest, 1, 3, infile) != 3 || std::memcmp(rest, binary_stream_magic + 1, 3))
+                throw std::string{ "bad binary stream header" };
+            decode_stream(infile, min_size, max_size);
+            continue;
+        }
+        std::putc(c, stdout);
+        at_line_start = c == '\n';
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned min_size = 0, max_size = ~0u;
+    const char * filename = nullptr;
+    for (int i = 1 ; i < argc ; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 11, "--min-size=") == 0)
+            min_size = std::stoul(arg.substr(11));
+        else if (arg.compare(0, 11, "--max-size=") == 0)
+            max_size = std::stoul(arg.substr(11));
+        else if (! filename && arg.compare(0, 2, "--") != 0)
+            filename = argv[i];
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--min-size=K] [--max-size=K] [FILE]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::FILE * infile = filename ? std::fopen(filename, "rb") : stdin;
+    if (! infile) {
+        std::cerr << "unable to open file " << filename << std::endl;
+        return 1;
+    }
+    try {
+        decode(infile, min_size, max_size);
+    } catch (const std::string & msg) {
+        std::fflush(stdout);
+        std::cerr << msg << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,109 @@
+// Combines the outputs of mcsp runs with --shard=0/k ... --shard=(k-1)/k into
+// the output of a single run: the solutions of every shard, followed by the
+// total solution and node counts.
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct ShardOutput
+{
+    std::string subtree;
+    unsigned long long solutions = 0;
+    unsigned long long nodes = 0;
+    unsigned long long time = 0;
+    bool timeout = false;
+};
+
+auto starts_with(const std::string & line, const std::string & prefix) -> bool
+{
+    return line.compare(0, prefix.size(), prefix) == 0;
+}
+
+auto value_of(const std::string & line) -> std::string
+{
+    auto pos = line.find_first_not_of(" ", line.find(':') + 1);
+    return pos == std::string::npos ? "" : line.substr(pos);
+}
+
+auto read_shard(const std::string & filename, std::vector<bool> & seen,
+        std::vector<std::string> & solution_lines) -> ShardOutput
+{
+    std::ifstream infile{ filename };
+    if (! infile)
+        throw "unable to open file " + filename;
+
+    ShardOutput output;
+    bool has_shard = false;
+    std::string line;
+    while (std::getline(infile, line)) {
+        if (starts_with(line, "  (")) {
+            solution_lines.push_back(line);
+        } else if (starts_with(line, "Shard:")) {
+            unsigned index, count;
+            if (2 != sscanf(value_of(line).c_str(), "%u/%u", &index, &count))
+                throw "bad shard line in " + filename;
+            if (seen.empty())
+                seen.resize(count, false);
+            if (count != seen.size())
+                throw "shards of different runs in " + filename;
+            if (index >= count || seen[index])
+                throw "duplicate shard in " + filename;
+            seen[index] = true;
+            has_shard = true;
+        } else if (starts_with(line, "Subtree:")) {
+            output.subtree = value_of(line);
+        } else if (starts_with(line, "Solutions:")) {
+            output.solutions = std::stoull(value_of(line));
+        } else if (starts_with(line, "Nodes:")) {
+            output.nodes = std::stoull(value_of(line));
+        } else if (starts_with(line, "CPU time (ms):")) {
+            output.time = std::stoull(value_of(line));
+        } else if (line == "TIMEOUT") {
+            output.timeout = true;
+        }
+    }
+    if (! has_shard)
+        throw "no shard line in " + filename;
+    return output;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " SHARD_OUTPUT..." << std::endl;
+        return 1;
+    }
+
+    std::vector<bool> seen;
+    std::vector<std::string> solution_lines;
+    ShardOutput total;
+    try {
+        for (int i = 1 ; i < argc ; ++i) {
+            auto output = read_shard(argv[i], seen, solution_lines);
+            if (i > 1 && output.subtree != total.subtree)
+                throw std::string{ "shards of different subtrees" };
+            total.subtree = output.subtree;
+            total.solutions += output.solutions;
+            total.nodes += output.nodes;
+            total.time += output.time;
+            total.timeout |= output.timeout;
+        }
+        for (unsigned i = 0 ; i < seen.size() ; ++i)
+            if (! seen[i])
+                throw "missing shard " + std::to_string(i);
+    } catch (const std::string & msg) {
+        std::cerr << msg << std::endl;
+        return 1;
+    }
+
+    for (auto & line : solution_lines)
+        std::cout << line << std::endl;
+    if (! total.subtree.empty())
+        std::cout << "Subtree:                    " << total.subtree << std::endl;
+    std::cout << "Solutions:                  " << total.solutions << std::endl;
+    std::cout << "Nodes:                      " << total.nodes << std::endl;
+    std::cout << "CPU time (ms):              " << total.time << std::endl;
+    if (total.timeout)
+        std::cout << "TIMEOUT" << std::endl;
+}